@@ -0,0 +1,191 @@
+/**
+@file aho.c
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The aho.c component implements the Aho-Corasick automaton. The strings are
+put in a trie, then failure links are worked out breadth first and folded
+into the trie's transitions, so every state has a transition for every
+character and a search is one table lookup per character. The columns of
+the table are byte classes: each character that appears in some string
+gets its own, and every other character shares one that always leads back
+to the root.
+<p>
+While the automaton is at its root, nothing has been partly matched, so
+it can skip ahead to the next character that starts one of the strings.
+The scan kernels look for those 64 characters at a time.
+*/
+
+/* Headers */
+#include "aho.h"
+#include "scan.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Constant Definitions */
+#define ALPHABET 256       /* Number of distinct characters in a string */
+#define INITIAL_STATES 64  /* Starting capacity of the transition table */
+#define SKIP_LIMIT 32      /* Most characters that can start a string for
+                              skipping ahead from the root to be worth it */
+
+
+/********************************************************************
+*
+*                        AHO-CORASICK DEFINITION
+*
+********************************************************************/
+struct AhoCorasickTag {
+  int32_t *next;              /* Transitions, nclasses per state */
+  bool *accept;               /* True for states that end some string */
+  int nstates;                /* Number of states, the root is state 0 */
+  int nclasses;               /* Number of byte classes */
+  uint8_t classOf[ALPHABET];  /* Byte class of each character */
+  ByteSet starts;             /* Characters that start some string */
+  bool skip;                  /* True if skipping ahead from the root */
+};
+
+/**
+Add a new state to the automaton with no transitions yet, growing the
+table if it's full.
+
+@param ac The automaton to add to.
+@param cap Capacity of the table, in states, updated if it grows.
+@return The index of the new state.
+*/
+static int addState(AhoCorasick *ac, int *cap)
+{
+  if (ac->nstates == *cap) {
+    *cap *= 2;
+    ac->next = (int32_t *)realloc(ac->next,
+      (size_t)*cap * ac->nclasses * sizeof(int32_t));
+    ac->accept = (bool *)realloc(ac->accept, *cap * sizeof(bool));
+  }
+
+  int s = ac->nstates++;
+  for (int k = 0; k < ac->nclasses; k++)
+    ac->next[(size_t)s * ac->nclasses + k] = -1;
+  ac->accept[s] = false;
+  return s;
+}
+
+AhoCorasick *makeAhoCorasick(int count, char *const *strs, size_t budget)
+{
+  AhoCorasick *ac = (AhoCorasick *)malloc(sizeof(AhoCorasick));
+
+  // Give each character used in a string its own class.
+  memset(ac->classOf, 0, sizeof(ac->classOf));
+  clearByteSet(&ac->starts);
+  ac->nclasses = 1;
+  for (int i = 0; i < count; i++) {
+    addByte(&ac->starts, strs[i][0]);
+    for (const char *p = strs[i]; *p; p++)
+      if (!ac->classOf[(unsigned char)*p])
+        ac->classOf[(unsigned char)*p] = ac->nclasses++;
+  }
+
+  int nstarts = 0;
+  for (int c = 0; c < ALPHABET; c++)
+    nstarts += inByteSet(&ac->starts, c);
+  ac->skip = nstarts <= SKIP_LIMIT;
+
+  // Build the trie, giving up if it gets too big.
+  int cap = INITIAL_STATES;
+  ac->next = (int32_t *)malloc((size_t)cap * ac->nclasses * sizeof(int32_t));
+  ac->accept = (bool *)malloc(cap * sizeof(bool));
+  ac->nstates = 0;
+  addState(ac, &cap);
+  for (int i = 0; i < count; i++) {
+    int s = 0;
+    for (const char *p = strs[i]; *p; p++) {
+      int32_t *t = &ac->next[(size_t)s * ac->nclasses +
+                             ac->classOf[(unsigned char)*p]];
+      if (*t < 0) {
+        if ((size_t)(ac->nstates + 1) * ac->nclasses * sizeof(int32_t) >
+            budget) {
+          freeAhoCorasick(ac);
+          return NULL;
+        }
+        int u = addState(ac, &cap);
+        t = &ac->next[(size_t)s * ac->nclasses +
+                      ac->classOf[(unsigned char)*p]];
+        *t = u;
+      }
+      s = *t;
+    }
+    ac->accept[s] = true;
+  }
+
+  // Visit states breadth first, so each state's failure state is finished
+  // before the state itself. A missing transition goes wherever the
+  // failure state's transition goes, and a state ending in some string
+  // accepts too.
+  int *fail = (int *)malloc(ac->nstates * sizeof(int));
+  int *queue = (int *)malloc(ac->nstates * sizeof(int));
+  int head = 0, tail = 0;
+  for (int k = 0; k < ac->nclasses; k++) {
+    int32_t *t = &ac->next[k];
+    if (*t < 0) {
+      *t = 0;
+    } else {
+      fail[*t] = 0;
+      queue[tail++] = *t;
+    }
+  }
+  while (head < tail) {
+    int s = queue[head++];
+    ac->accept[s] |= ac->accept[fail[s]];
+    for (int k = 0; k < ac->nclasses; k++) {
+      int32_t *t = &ac->next[(size_t)s * ac->nclasses + k];
+      int f = ac->next[(size_t)fail[s] * ac->nclasses + k];
+      if (*t < 0) {
+        *t = f;
+      } else {
+        fail[*t] = f;
+        queue[tail++] = *t;
+      }
+    }
+  }
+  free(fail);
+  free(queue);
+
+  return ac;
+}
+
+bool acSearch(const AhoCorasick *ac, const char *buf, long len, long *pos)
+{
+  const int32_t *next = ac->next;
+  int nclasses = ac->nclasses;
+  int s = 0;
+
+  for (long i = *pos; i < len; i++) {
+    // At the root, skip to the next character that could start a string.
+    if (s == 0 && ac->skip) {
+      uint64_t hits = 0;
+      while (i < len) {
+        int n = len - i < SCAN_WIDTH ? len - i : SCAN_WIDTH;
+        if ((hits = scanByteSet(&ac->starts, buf + i, n)))
+          break;
+        i += n;
+      }
+      if (!hits)
+        break;
+      i += __builtin_ctzll(hits);
+    }
+
+    s = next[(size_t)s * nclasses + ac->classOf[(unsigned char)buf[i]]];
+    if (ac->accept[s]) {
+      *pos = i;
+      return true;
+    }
+  }
+
+  *pos = len;
+  return false;
+}
+
+void freeAhoCorasick(AhoCorasick *ac)
+{
+  free(ac->next);
+  free(ac->accept);
+  free(ac);
+}
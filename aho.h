@@ -0,0 +1,52 @@
+/**
+@file aho.h
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The aho.h file contains the interface for an Aho-Corasick automaton, which
+finds occurrences of any of a set of literal strings in a single pass over
+its input, no matter how many strings there are. mygrep uses it in place of
+the DFA for patterns that only match a known, finite set of strings, like
+a long alternation of words.
+*/
+#ifndef _AHO_H_
+#define _AHO_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** A short name to use for an Aho-Corasick automaton. */
+typedef struct AhoCorasickTag AhoCorasick;
+
+/**
+Make an automaton that finds any of the given strings.
+
+@param count Number of strings.
+@param strs The strings to find. None of them can be empty or contain a
+            newline.
+@param budget Most bytes the automaton's transition table may take.
+@return A dynamically allocated automaton, or NULL if its table would be
+        bigger than budget.
+*/
+AhoCorasick *makeAhoCorasick(int count, char *const *strs, size_t budget);
+
+/**
+Find the first occurrence of any of the automaton's strings in a buffer.
+The automaton isn't changed, so several threads can share it.
+
+@param ac The automaton to run.
+@param buf The buffer to search.
+@param len Length of the buffer.
+@param pos Location to start searching from. If a string is found, it's
+           set to the location of the string's last character.
+@return True if one of the strings was found.
+*/
+bool acSearch(const AhoCorasick *ac, const char *buf, long len, long *pos);
+
+/**
+Free the memory for an automaton.
+
+@param ac The automaton to free.
+*/
+void freeAhoCorasick(AhoCorasick *ac);
+
+#endif
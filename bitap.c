@@ -0,0 +1,223 @@
+/**
+@file bitap.c
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The bitap.c component implements the Shift-And matcher. It's built from a
+compiled Program by numbering the instructions that match a character,
+then following branches from each one to find which positions can come
+right after it (its follow set), and which ones a match can start or end
+with. Matching a line is then a loop over its characters that keeps the
+set of positions just matched as the bits of a word.
+<p>
+Following from a whole set of positions at once would take a loop over
+its bits, so the follow sets are kept in tables indexed by 8 positions at
+a time. A step costs one lookup per 8 positions in the program.
+*/
+
+/* Headers */
+#include "bitap.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Constant Definitions */
+#define ALPHABET 256                        /* Number of distinct characters */
+#define CHUNK_BITS 8                        /* Positions per follow table */
+#define MAX_CHUNKS (BITAP_MAX_POSITIONS / CHUNK_BITS)
+
+
+/********************************************************************
+*
+*                          BITAP DEFINITION
+*
+********************************************************************/
+struct BitapTag {
+  uint64_t accept[ALPHABET];      /* Positions that match each character */
+  uint64_t follow[MAX_CHUNKS][ALPHABET]; /* Positions that can come after
+                                     each set of 8 positions */
+  int nchunks;                    /* Number of follow tables in use */
+  uint64_t first;                 /* Positions a match can start with */
+  uint64_t firstBol;              /* Same, at the start of the line */
+  uint64_t last;                  /* Positions a match can end with */
+  uint64_t lastEol;               /* Same, at the end of the line */
+  bool empty[2][2];               /* True if the program matches the empty
+                                     string, by [at start][at end] of line */
+};
+
+/**
+Temporary storage used while a Bitap is made.
+*/
+typedef struct {
+  const Program *prog;    /* Program the Bitap is being made for */
+  int *position;          /* Position of each instruction, or -1 */
+  bool *seen;             /* Instructions already reached by a closure */
+  int *stack;             /* Work stack for following branches */
+} Builder;
+
+/**
+Find every position reachable from instruction pc without matching a
+character.
+
+@param bld The builder with the program and its positions.
+@param pc Index of the instruction to start from.
+@param bol True if the location is the start of the line.
+@param eol True if the location is the end of the line.
+@param match Set to true if the match instruction is reachable too.
+@return The set of positions reached.
+*/
+static uint64_t closure(Builder *bld, int pc, bool bol, bool eol, bool *match)
+{
+  const Instruction *inst = bld->prog->inst;
+  uint64_t set = 0;
+  int top = 0;
+
+  memset(bld->seen, 0, bld->prog->len * sizeof(bool));
+  *match = false;
+  bld->stack[top++] = pc;
+  while (top > 0) {
+    pc = bld->stack[--top];
+    if (bld->seen[pc])
+      continue;
+    bld->seen[pc] = true;
+
+    switch (inst[pc].op) {
+    case OP_CHAR:
+    case OP_ANY:
+    case OP_CLASS:
+      set |= (uint64_t)1 << bld->position[pc];
+      break;
+    case OP_MATCH:
+      *match = true;
+      break;
+    case OP_JMP:
+      bld->stack[top++] = inst[pc].x;
+      break;
+    case OP_SPLIT:
+      bld->stack[top++] = inst[pc].y;
+      bld->stack[top++] = inst[pc].x;
+      break;
+    case OP_BOL:
+      if (bol)
+        bld->stack[top++] = pc + 1;
+      break;
+    case OP_EOL:
+      if (eol)
+        bld->stack[top++] = pc + 1;
+      break;
+    case OP_SAVE:
+      bld->stack[top++] = pc + 1;
+      break;
+    }
+  }
+
+  return set;
+}
+
+/**
+Return true if instruction pc matches character c.
+*/
+static bool matchesChar(const Program *prog, int pc, unsigned char c)
+{
+  const Instruction *in = &prog->inst[pc];
+  return in->op == OP_ANY ||
+    (in->op == OP_CHAR && (unsigned char)in->sym == c) ||
+    (in->op == OP_CLASS && inByteSet(&prog->sets[in->x], c));
+}
+
+Bitap *makeBitap(const Program *prog)
+{
+  // Number the positions, giving up if there are too many.
+  Builder bld;
+  bld.prog = prog;
+  bld.position = (int *)malloc(prog->len * sizeof(int));
+  int npos = 0;
+  for (int pc = 0; pc < prog->len; pc++) {
+    Opcode op = prog->inst[pc].op;
+    bool consumes = op == OP_CHAR || op == OP_ANY || op == OP_CLASS;
+    bld.position[pc] = consumes ? npos++ : -1;
+  }
+  if (npos > BITAP_MAX_POSITIONS) {
+    free(bld.position);
+    return NULL;
+  }
+  bld.seen = (bool *)malloc(prog->len * sizeof(bool));
+  bld.stack = (int *)malloc((2 * prog->len + 1) * sizeof(int));
+
+  Bitap *b = (Bitap *)calloc(1, sizeof(Bitap));
+  b->nchunks = (npos + CHUNK_BITS - 1) / CHUNK_BITS;
+
+  // Where a match can start, and whether it can be empty.
+  bool match;
+  b->first = closure(&bld, 0, false, false, &match);
+  b->empty[0][0] = match;
+  b->firstBol = closure(&bld, 0, true, false, &match);
+  b->empty[1][0] = match;
+  closure(&bld, 0, false, true, &b->empty[0][1]);
+  closure(&bld, 0, true, true, &b->empty[1][1]);
+
+  // What each position matches, and where it can go from there.
+  uint64_t follow[BITAP_MAX_POSITIONS];
+  for (int pc = 0; pc < prog->len; pc++) {
+    int p = bld.position[pc];
+    if (p < 0)
+      continue;
+
+    for (int c = 0; c < ALPHABET; c++)
+      if (matchesChar(prog, pc, c))
+        b->accept[c] |= (uint64_t)1 << p;
+
+    follow[p] = closure(&bld, pc + 1, false, false, &match);
+    if (match)
+      b->last |= (uint64_t)1 << p;
+    closure(&bld, pc + 1, false, true, &match);
+    if (match)
+      b->lastEol |= (uint64_t)1 << p;
+  }
+
+  // Each follow table entry is the union for the positions in its index,
+  // built from the entry with its lowest bit cleared.
+  for (int k = 0; k < b->nchunks; k++)
+    for (int v = 1; v < ALPHABET; v++) {
+      int low = __builtin_ctz(v);
+      int p = k * CHUNK_BITS + low;
+      b->follow[k][v] = b->follow[k][v & (v - 1)] | (p < npos ? follow[p] : 0);
+    }
+
+  free(bld.position);
+  free(bld.seen);
+  free(bld.stack);
+  return b;
+}
+
+bool runBitap(const Bitap *b, long len, const char *str)
+{
+  // Matches of the empty string don't need any characters at all.
+  if (b->empty[1][len == 0] || (len > 0 && b->empty[0][1]) ||
+      (len > 1 && b->empty[0][0]))
+    return true;
+
+  // Positions that could match the next character, and ones just matched.
+  uint64_t live = b->firstBol;
+  uint64_t matched = 0;
+  for (long i = 0; i < len; i++) {
+    // With no positions left, and none starting past the start of the line
+    // (like for a pattern that begins with ^), nothing else can match.
+    if (!live)
+      return false;
+    matched = live & b->accept[(unsigned char)str[i]];
+    if (matched & b->last)
+      return true;
+
+    // Go on to everything that can follow, or start a new match here.
+    live = b->first;
+    for (int k = 0; k < b->nchunks; k++)
+      live |= b->follow[k][(matched >> (k * CHUNK_BITS)) & 0xff];
+  }
+
+  return (matched & b->lastEol) != 0;
+}
+
+void freeBitap(Bitap *b)
+{
+  free(b);
+}
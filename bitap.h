@@ -0,0 +1,52 @@
+/**
+@file bitap.h
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The bitap.h file contains the interface for a Shift-And (bitap) matcher for
+programs with at most 64 positions, where a position is an instruction
+that matches a character. This is the Glushkov automaton for the pattern:
+its states are positions, so the set of live ones fits in a single 64-bit
+word, and stepping over a character is a few table lookups, an OR and an
+AND, with no memory allocated while matching.
+*/
+#ifndef _BITAP_H_
+#define _BITAP_H_
+
+#include <stdbool.h>
+#include "program.h"
+
+/** Most positions a program can have for a Bitap to be made for it. */
+#define BITAP_MAX_POSITIONS 64
+
+/** A short name to use for a Shift-And matcher. */
+typedef struct BitapTag Bitap;
+
+/**
+Make a Shift-And matcher for the given program, if it's small enough.
+
+@param prog The program to match with. It's only used while the matcher is
+            made.
+@return A dynamically allocated matcher, or NULL if prog has more than
+        BITAP_MAX_POSITIONS positions.
+*/
+Bitap *makeBitap(const Program *prog);
+
+/**
+Return true if the matcher's program matches anywhere in the given string.
+The matcher isn't changed, so several threads can share it.
+
+@param b The matcher to run.
+@param len Length of the string.
+@param str The input string being matched against.
+@return True if the string contains a match.
+*/
+bool runBitap(const Bitap *b, long len, const char *str);
+
+/**
+Free the memory for a matcher.
+
+@param b The matcher to free.
+*/
+void freeBitap(Bitap *b);
+
+#endif
@@ -0,0 +1,510 @@
+/**
+@file capture.c
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The capture.c component finds where the groups in a pattern matched. It's
+only used once the DFAs have found where a match starts and ends, so it
+never has to search: it just works out how the program got from one to
+the other.
+<p>
+Most patterns people capture with, like ^([a-z]+)=([0-9]+)$, are one-pass:
+wherever a thread can be between characters, each character it could see
+next leads along only one path of instructions. For those, the paths are
+worked out once, when the finder is made, and matching is a single thread
+following them. Anything else is run by a Pike VM, where each thread
+carries its own copy of the slots.
+*/
+
+/* Headers */
+#include "capture.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Constant Definitions */
+#define ONE_PASS_LIMIT 1000  /* Most instructions in a program that's
+                                checked for being one-pass */
+
+
+/********************************************************************
+*
+*                          CAPTURER DEFINITION
+*
+********************************************************************/
+/**
+One path a thread can take from where it is between characters, without
+matching a character, to an instruction that matches one or reports a
+match.
+*/
+typedef struct {
+  int pc;           /* Instruction the path leads to */
+  bool bol;         /* True if it goes through a start anchor */
+  bool eol;         /* True if it goes through an end anchor */
+  int first;        /* Index of the first slot it records, in saves */
+  int nsaves;       /* Number of slots it records */
+} Edge;
+
+/**
+A set of threads, like the Machine's, along with the slots each one has
+recorded so far.
+*/
+typedef struct {
+  int *dense;       /* Instruction indices in the set, in priority order */
+  int *sparse;      /* Position of each instruction index in dense */
+  long *slots;      /* Slots for each thread, nslots apiece, by position in
+                       dense */
+  int n;            /* Number of threads in the set */
+} SlotList;
+
+/**
+An entry on the stack for following branches. It's either an instruction
+to go on to, or a slot to put back the way it was once everything after
+the OP_SAVE that changed it has been followed.
+*/
+typedef struct {
+  int pc;           /* Instruction to go on to, if slot is negative */
+  int slot;         /* Slot to put back, or -1 */
+  long old;         /* Value to put back in slot */
+} Frame;
+
+struct CapturerTag {
+  const Program *prog;  /* Program this finder runs */
+  bool onePass;         /* True if the program is one-pass */
+
+  int *firstEdge;       /* Index in edges of the first path from each
+                           instruction a thread can be at between
+                           characters, for a one-pass program */
+  int *nedges;          /* Number of paths from each one */
+  Edge *edges;          /* Every path, grouped by where it starts */
+  int edgeCount;        /* Number of entries in edges */
+  int edgeCap;          /* Capacity of edges */
+  int *saves;           /* Slots recorded along each path */
+  int saveCount;        /* Number of entries in saves */
+  int saveCap;          /* Capacity of saves */
+
+  SlotList clist;       /* Threads at the current location */
+  SlotList nlist;       /* Threads at the next location */
+  Frame *stack;         /* Work stack for following branches */
+  long *work;           /* Slots along the path being followed */
+};
+
+/**
+Return true if instruction pc matches a character, rather than being one
+that's followed without matching one.
+*/
+static bool consumes(const Program *prog, int pc)
+{
+  Opcode op = prog->inst[pc].op;
+  return op == OP_CHAR || op == OP_ANY || op == OP_CLASS;
+}
+
+/**
+Return true if instruction pc matches character c.
+*/
+static bool matchesChar(const Program *prog, int pc, unsigned char c)
+{
+  const Instruction *in = &prog->inst[pc];
+  return in->op == OP_ANY ||
+    (in->op == OP_CHAR && (unsigned char)in->sym == c) ||
+    (in->op == OP_CLASS && inByteSet(&prog->sets[in->x], c));
+}
+
+
+/********************************************************************
+*
+*                          ONE-PASS PROGRAMS
+*
+********************************************************************/
+/**
+Add a path to the list of paths, working back from the instruction it
+leads to, through the instruction each one was reached from, to record
+the slots and anchors along the way.
+
+@param c The finder being made.
+@param pc The instruction the path leads to.
+@param from The instruction each instruction on the path was reached from.
+@param root The instruction the path starts at.
+*/
+static void addEdge(Capturer *c, int pc, const int *from, int root)
+{
+  if (c->edgeCount == c->edgeCap) {
+    c->edgeCap *= 2;
+    c->edges = (Edge *)realloc(c->edges, c->edgeCap * sizeof(Edge));
+  }
+  Edge *e = &c->edges[c->edgeCount++];
+  e->pc = pc;
+  e->bol = e->eol = false;
+  e->first = c->saveCount;
+  e->nsaves = 0;
+
+  const Instruction *inst = c->prog->inst;
+  for (int at = pc; at != root; ) {
+    at = from[at];
+    if (inst[at].op == OP_BOL)
+      e->bol = true;
+    else if (inst[at].op == OP_EOL)
+      e->eol = true;
+    else if (inst[at].op == OP_SAVE) {
+      if (c->saveCount == c->saveCap) {
+        c->saveCap *= 2;
+        c->saves = (int *)realloc(c->saves, c->saveCap * sizeof(int));
+      }
+      c->saves[c->saveCount++] = inst[at].x;
+      e->nsaves++;
+    }
+  }
+}
+
+/**
+Find every path from an instruction a thread can be at between
+characters, and check that the next character always decides which one
+to take. That's not so if two paths lead to the same instruction, or to
+instructions that match some of the same characters, or if two lead to a
+match. Paths through anchors are counted even though they might not be
+open, so this is conservative.
+
+@param c The finder being made.
+@param root The instruction to start from.
+@param from Scratch space for the instruction each one was reached from.
+@param seen Scratch space for the last root each instruction was reached
+            from, so it doesn't need to be cleared for each one.
+@return True if the paths from root are one-pass.
+*/
+static bool addEdges(Capturer *c, int root, int *from, int *seen)
+{
+  const Program *prog = c->prog;
+  const Instruction *inst = prog->inst;
+  ByteSet used;
+  clearByteSet(&used);
+  bool match = false;
+
+  c->firstEdge[root] = c->edgeCount;
+  int top = 0;
+  c->stack[top++].pc = root;
+  from[root] = root;
+  while (top > 0) {
+    int pc = c->stack[--top].pc;
+    if (seen[pc] == root)
+      return false;
+    seen[pc] = root;
+
+    switch (inst[pc].op) {
+    case OP_JMP:
+      from[inst[pc].x] = pc;
+      c->stack[top++].pc = inst[pc].x;
+      break;
+    case OP_SPLIT:
+      from[inst[pc].y] = pc;
+      c->stack[top++].pc = inst[pc].y;
+      from[inst[pc].x] = pc;
+      c->stack[top++].pc = inst[pc].x;
+      break;
+    case OP_BOL:
+    case OP_EOL:
+    case OP_SAVE:
+      from[pc + 1] = pc;
+      c->stack[top++].pc = pc + 1;
+      break;
+    case OP_MATCH:
+      if (match)
+        return false;
+      match = true;
+      addEdge(c, pc, from, root);
+      break;
+    default:
+      // Instructions that match a character can't share any with the
+      // ones already found.
+      for (int ch = 0; ch < 256; ch++)
+        if (matchesChar(prog, pc, ch)) {
+          if (inByteSet(&used, ch))
+            return false;
+          addByte(&used, ch);
+        }
+      addEdge(c, pc, from, root);
+      break;
+    }
+  }
+
+  c->nedges[root] = c->edgeCount - c->firstEdge[root];
+  return true;
+}
+
+/**
+Work out whether a program is one-pass, finding the paths from every
+instruction a thread can be at between characters if it is: the start of
+the program, and right after each instruction that matches a character.
+
+@param c The finder being made.
+@return True if the program is one-pass.
+*/
+static bool findEdges(Capturer *c)
+{
+  const Program *prog = c->prog;
+  if (prog->len > ONE_PASS_LIMIT)
+    return false;
+
+  c->firstEdge = (int *)malloc(prog->len * sizeof(int));
+  c->nedges = (int *)calloc(prog->len, sizeof(int));
+  c->edgeCap = c->saveCap = prog->len;
+  c->edges = (Edge *)malloc(c->edgeCap * sizeof(Edge));
+  c->saves = (int *)malloc(c->saveCap * sizeof(int));
+
+  int *from = (int *)malloc(prog->len * sizeof(int));
+  int *seen = (int *)malloc(prog->len * sizeof(int));
+  for (int pc = 0; pc < prog->len; pc++)
+    seen[pc] = -1;
+
+  bool onePass = true;
+  for (int root = 0; root < prog->len && onePass; root++)
+    if (root == 0 || consumes(prog, root - 1))
+      onePass = addEdges(c, root, from, seen);
+
+  free(from);
+  free(seen);
+  return onePass;
+}
+
+/**
+Follow the one path a match can take through a one-pass program, recording
+slots along the way.
+
+@param c The finder to run.
+@param len Length of the string.
+@param str The input string being matched against.
+@param start Location where the match starts.
+@param end Location just past the end of the match.
+@param slots The slots to record in.
+@return True if the program matches from start to end.
+*/
+static bool runOnePass(Capturer *c, long len, const char *str, long start,
+  long end, long *slots)
+{
+  const Program *prog = c->prog;
+  int root = 0;
+  for (long pos = start; ; pos++) {
+    // Before the end, the character decides which path to take, and at
+    // the end, it's the one to the match.
+    const Edge *taken = NULL;
+    const Edge *e = c->edges + c->firstEdge[root];
+    for (int i = 0; i < c->nedges[root] && !taken; i++, e++) {
+      if ((e->bol && pos != 0) || (e->eol && pos != len))
+        continue;
+      if (pos == end ? prog->inst[e->pc].op == OP_MATCH :
+          consumes(prog, e->pc) && matchesChar(prog, e->pc, str[pos]))
+        taken = e;
+    }
+    if (!taken)
+      return false;
+
+    for (int i = 0; i < taken->nsaves; i++)
+      slots[c->saves[taken->first + i]] = pos;
+    if (pos == end)
+      return true;
+    root = taken->pc + 1;
+  }
+}
+
+
+/********************************************************************
+*
+*                          PIKE VM
+*
+********************************************************************/
+/**
+Return true if the given instruction is already in the thread list.
+*/
+static bool onList(const SlotList *list, int pc)
+{
+  int i = list->sparse[pc];
+  return i < list->n && list->dense[i] == pc;
+}
+
+/**
+Add a thread for instruction pc to the list, along with every instruction
+that can be reached from it without matching a character, just like the
+Machine does. Branches are followed first one first, so the threads stay
+in priority order, and each OP_SAVE changes the working slots for just the
+instructions after it. Threads that match a character or have matched
+keep a copy of the slots they got there with.
+
+@param c The finder the list belongs to.
+@param list The list to add threads to.
+@param pc Index of the instruction to start from.
+@param pos Location in the string the threads are at.
+@param len Length of the string.
+*/
+static void addThread(Capturer *c, SlotList *list, int pc, long pos,
+  long len)
+{
+  const Instruction *inst = c->prog->inst;
+  int nslots = c->prog->nslots;
+  int top = 0;
+
+  c->stack[top++] = (Frame){ pc, -1, 0 };
+  while (top > 0) {
+    Frame f = c->stack[--top];
+    if (f.slot >= 0) {
+      c->work[f.slot] = f.old;
+      continue;
+    }
+    pc = f.pc;
+    if (onList(list, pc))
+      continue;
+    list->sparse[pc] = list->n;
+    long *slots = list->slots + list->n * nslots;
+    list->dense[list->n++] = pc;
+
+    switch (inst[pc].op) {
+    case OP_JMP:
+      c->stack[top++] = (Frame){ inst[pc].x, -1, 0 };
+      break;
+    case OP_SPLIT:
+      c->stack[top++] = (Frame){ inst[pc].y, -1, 0 };
+      c->stack[top++] = (Frame){ inst[pc].x, -1, 0 };
+      break;
+    case OP_BOL:
+      if (pos == 0)
+        c->stack[top++] = (Frame){ pc + 1, -1, 0 };
+      break;
+    case OP_EOL:
+      if (pos == len)
+        c->stack[top++] = (Frame){ pc + 1, -1, 0 };
+      break;
+    case OP_SAVE:
+      c->stack[top++] = (Frame){ 0, inst[pc].x, c->work[inst[pc].x] };
+      c->work[inst[pc].x] = pos;
+      c->stack[top++] = (Frame){ pc + 1, -1, 0 };
+      break;
+    default:
+      memcpy(slots, c->work, nslots * sizeof(long));
+      break;
+    }
+  }
+}
+
+/**
+Run every thread from the start of a match to its end, keeping the slots
+of the first one, in priority order, that matches there.
+
+@param c The finder to run.
+@param len Length of the string.
+@param str The input string being matched against.
+@param start Location where the match starts.
+@param end Location just past the end of the match.
+@param slots The slots to record in.
+@return True if the program matches from start to end.
+*/
+static bool runPikeVM(Capturer *c, long len, const char *str, long start,
+  long end, long *slots)
+{
+  const Program *prog = c->prog;
+  int nslots = prog->nslots;
+  SlotList *clist = &c->clist;
+  SlotList *nlist = &c->nlist;
+
+  memcpy(c->work, slots, nslots * sizeof(long));
+  clist->n = 0;
+  addThread(c, clist, 0, start, len);
+  for (long pos = start; clist->n > 0; pos++) {
+    if (pos == end) {
+      for (int i = 0; i < clist->n; i++)
+        if (prog->inst[clist->dense[i]].op == OP_MATCH) {
+          memcpy(slots, clist->slots + i * nslots, nslots * sizeof(long));
+          return true;
+        }
+      return false;
+    }
+
+    nlist->n = 0;
+    for (int i = 0; i < clist->n; i++) {
+      int pc = clist->dense[i];
+      if (consumes(prog, pc) && matchesChar(prog, pc, str[pos])) {
+        memcpy(c->work, clist->slots + i * nslots, nslots * sizeof(long));
+        addThread(c, nlist, pc + 1, pos + 1, len);
+      }
+    }
+
+    SlotList *tmp = clist;
+    clist = nlist;
+    nlist = tmp;
+  }
+
+  return false;
+}
+
+
+/********************************************************************
+*
+*                          CAPTURER FUNCTIONS
+*
+********************************************************************/
+/**
+Allocate the storage for a list of threads.
+*/
+static void initList(SlotList *list, const Program *prog)
+{
+  list->dense = (int *)malloc(prog->len * sizeof(int));
+  list->sparse = (int *)calloc(prog->len, sizeof(int));
+  list->slots = (long *)malloc((size_t)prog->len * prog->nslots *
+    sizeof(long));
+  list->n = 0;
+}
+
+/**
+Free the storage for a list of threads.
+*/
+static void freeList(SlotList *list)
+{
+  free(list->dense);
+  free(list->sparse);
+  free(list->slots);
+}
+
+Capturer *makeCapturer(const Program *prog)
+{
+  Capturer *c = (Capturer *)malloc(sizeof(Capturer));
+  c->prog = prog;
+  c->firstEdge = c->nedges = c->saves = NULL;
+  c->edges = NULL;
+  c->edgeCount = c->saveCount = 0;
+
+  // Every instruction can be on the stack at most twice, once to go on to
+  // it and once to put back a slot it changed.
+  c->stack = (Frame *)malloc((2 * prog->len + 1) * sizeof(Frame));
+  c->work = (long *)malloc(prog->nslots * sizeof(long));
+
+  // The Pike VM's storage is only needed if the program isn't one-pass.
+  c->onePass = findEdges(c);
+  if (!c->onePass) {
+    initList(&c->clist, prog);
+    initList(&c->nlist, prog);
+  }
+  return c;
+}
+
+bool runCapturer(Capturer *c, long len, const char *str, long start,
+  long end, long *slots)
+{
+  for (int i = 0; i < c->prog->nslots; i++)
+    slots[i] = -1;
+
+  bool found = c->onePass ? runOnePass(c, len, str, start, end, slots) :
+                            runPikeVM(c, len, str, start, end, slots);
+  slots[0] = start;
+  slots[1] = end;
+  return found;
+}
+
+void freeCapturer(Capturer *c)
+{
+  if (!c->onePass) {
+    freeList(&c->clist);
+    freeList(&c->nlist);
+  }
+  free(c->firstEdge);
+  free(c->nedges);
+  free(c->edges);
+  free(c->saves);
+  free(c->stack);
+  free(c->work);
+  free(c);
+}
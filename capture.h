@@ -0,0 +1,60 @@
+/**
+@file capture.h
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The capture.h file contains the interface for finding where the groups in
+a pattern matched, once the other engines have found where the whole match
+is. It runs a program compiled with OP_SAVE instructions, which record
+locations in numbered slots.
+<p>
+If the program is one-pass, so at every location the next character
+decides which way to go, a single thread follows the match, and the slots
+are just filled in along the way. Otherwise, it's a Pike VM where every
+thread has slots of its own, and of the threads that reach the end of the
+match, the one that got there by the first alternatives and the longest
+repetitions wins.
+*/
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdbool.h>
+#include "program.h"
+
+/** A short name to use for a submatch finder. */
+typedef struct CapturerTag Capturer;
+
+/**
+Make a submatch finder for the given program, and work out whether it's
+one-pass.
+
+@param prog The program to run, compiled by compileCapturePatternSet(). It
+            must outlive the finder.
+@return A dynamically allocated finder for prog.
+*/
+Capturer *makeCapturer(const Program *prog);
+
+/**
+Find where each group matched, for a match whose start and end are
+already known.
+
+@param c The finder to run.
+@param len Length of the string.
+@param str The input string being matched against.
+@param start Location where the match starts.
+@param end Location just past the end of the match.
+@param slots An array of prog->nslots entries. Slots 0 and 1 are set to
+             start and end, and slots 2k and 2k + 1 to the start and end
+             of group k, or -1 if it didn't take part in the match.
+@return True if the program matches from start to end.
+*/
+bool runCapturer(Capturer *c, long len, const char *str, long start,
+  long end, long *slots);
+
+/**
+Free the memory for a submatch finder.
+
+@param c The finder to free.
+*/
+void freeCapturer(Capturer *c);
+
+#endif
@@ -0,0 +1,652 @@
+/**
+@file dfa.c
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The dfa.c component implements a lazily built DFA on top of a compiled
+Program. A state is the sorted set of instructions the Machine would have
+as threads at some location, and its transition for a character is only
+computed (by stepping those threads, just like the Machine does) the first
+time a search needs it. After that, it's a single table lookup. Tables
+have a column per byte class rather than per character, since most
+patterns only tell a few characters apart. A search spends most of its
+time in the state between matches, which usually only a few characters
+leave, so it skips to the next of those with the scan kernels.
+<p>
+An anchored DFA only follows matches from the location it was started
+at, so it can find where the leftmost-longest match ends once its start
+is known. The start itself is found by running an ordinary DFA for the
+program compiled in reverse backward over the line.
+*/
+
+/* Headers */
+#include "dfa.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Constant Definitions */
+#define ALPHABET 256         /* Number of distinct characters in a string */
+#define INITIAL_BUCKETS 64   /* Starting size of the state hash table */
+#define MIN_PROGRESS 10      /* Characters per cached state a search must
+                                get through before it may flush the cache */
+#define SKIP_EXITS 16        /* Most characters that can leave the state
+                                between matches for searches to skip to
+                                the next of them */
+#define SKIP_TRIAL 256       /* Skips to try before judging them */
+#define SKIP_MIN_RUN 32      /* Characters each skip has to get past on
+                                average to be worth keeping */
+
+
+/********************************************************************
+*
+*                          DFA DEFINITION
+*
+********************************************************************/
+/** A short name to use for a DFA state. */
+typedef struct StateTag State;
+
+/** One cached state of the DFA. */
+struct StateTag {
+  State *chain;           /* Next state in the same hash bucket */
+  State *link;            /* Next state in the list of all cached states */
+  unsigned hash;          /* Hash of atStart and pcs */
+  bool atStart;           /* True for the state at the start of the line */
+  bool match;             /* True if the pattern has already matched */
+  bool eolMatch;          /* True if the pattern matches if the line ends */
+  bool dead;              /* True if nothing on the rest of the line can
+                             match, because no thread is left and none can
+                             start after the start of the line (or at all,
+                             for an anchored DFA) */
+  bool skip;              /* True if only a few characters leave the state,
+                             so searches skip to the next of them: a
+                             newline for a dead state, or the ones in the
+                             DFA's skip set for its midStart */
+  int npcs;               /* Number of instructions in the state */
+  int *pcs;               /* Sorted instruction indices in the state, stored
+                             right after next */
+  State *next[];          /* Transition for each byte class, NULL if not
+                             computed yet */
+};
+
+struct DFATag {
+  const Program *prog;    /* Program this DFA is for */
+  bool anchored;          /* True if matches only start where it starts */
+  size_t budget;          /* Bytes of cached states allowed */
+  size_t used;            /* Bytes of cached states right now */
+  State *start;           /* Cached start state, or NULL */
+  State *midStart;        /* Cached start state for the middle of a line,
+                             or NULL. For an ordinary DFA, it's the state
+                             between matches, with no thread but the one
+                             started at each location */
+  ByteSet skip;           /* Characters that leave midStart */
+  long skips;             /* Skips since skip was worked out */
+  long skipped;           /* Characters they got past */
+  State *states;          /* List of all cached states */
+  int nstates;            /* Number of cached states */
+  State **buckets;        /* Hash table of cached states */
+  int nbuckets;           /* Size of the hash table, a power of two */
+  long flushPos;          /* Location of the last flush in this search */
+  unsigned char classOf[ALPHABET]; /* Byte class of each character */
+  int nclasses;           /* Number of byte classes */
+
+  int *dense;             /* Sparse set of instructions being collected */
+  int *sparse;
+  int nset;
+  int *stack;             /* Work stack for following branches */
+  int *key;               /* Sorted instructions for the state being built */
+  int nkey;
+};
+
+/**
+Add pc to the set of instructions being collected, along with everything
+reachable from it without matching a character.
+
+@param d The DFA collecting the set.
+@param pc Index of the instruction to start from.
+@param bol True if the location is the start of the line.
+@param eol True if the location is the end of the line.
+*/
+static void addClosure(DFA *d, int pc, bool bol, bool eol)
+{
+  const Instruction *inst = d->prog->inst;
+  int top = 0;
+
+  d->stack[top++] = pc;
+  while (top > 0) {
+    pc = d->stack[--top];
+    int i = d->sparse[pc];
+    if (i < d->nset && d->dense[i] == pc)
+      continue;
+    d->sparse[pc] = d->nset;
+    d->dense[d->nset++] = pc;
+
+    switch (inst[pc].op) {
+    case OP_JMP:
+      d->stack[top++] = inst[pc].x;
+      break;
+    case OP_SPLIT:
+      d->stack[top++] = inst[pc].y;
+      d->stack[top++] = inst[pc].x;
+      break;
+    case OP_BOL:
+      if (bol)
+        d->stack[top++] = pc + 1;
+      break;
+    case OP_EOL:
+      if (eol)
+        d->stack[top++] = pc + 1;
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+/**
+Comparison function for sorting instruction indices.
+*/
+static int comparePCs(const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b;
+}
+
+/**
+Turn the set of instructions collected by addClosure() into a key for a
+state. Only instructions that still have work to do at a later location
+are kept: ones that match a character, the match instruction and end
+anchors that haven't been satisfied yet.
+
+@param d The DFA building a state.
+*/
+static void makeKey(DFA *d)
+{
+  const Instruction *inst = d->prog->inst;
+  d->nkey = 0;
+  for (int i = 0; i < d->nset; i++) {
+    Opcode op = inst[d->dense[i]].op;
+    if (op == OP_CHAR || op == OP_ANY || op == OP_CLASS || op == OP_MATCH ||
+        op == OP_EOL)
+      d->key[d->nkey++] = d->dense[i];
+  }
+  qsort(d->key, d->nkey, sizeof(int), comparePCs);
+}
+
+/**
+Return a hash for the current key.
+*/
+static unsigned hashKey(const DFA *d, bool atStart)
+{
+  unsigned h = 2166136261u ^ atStart;
+  for (int i = 0; i < d->nkey; i++)
+    h = (h ^ (unsigned)d->key[i]) * 16777619u;
+  return h;
+}
+
+/**
+Double the size of the hash table, moving every cached state over.
+*/
+static void growBuckets(DFA *d)
+{
+  int nbuckets = d->nbuckets * 2;
+  State **buckets = (State **)calloc(nbuckets, sizeof(State *));
+  for (State *s = d->states; s; s = s->link) {
+    int b = s->hash & (nbuckets - 1);
+    s->chain = buckets[b];
+    buckets[b] = s;
+  }
+  free(d->buckets);
+  d->buckets = buckets;
+  d->nbuckets = nbuckets;
+}
+
+/**
+Return the cached state for the current key, making it if it's not in the
+cache yet.
+
+@param d The DFA to look in.
+@param atStart True if this is the state for the start of the line.
+@return The state, or NULL if making it would go over the budget.
+*/
+static State *cachedState(DFA *d, bool atStart)
+{
+  unsigned h = hashKey(d, atStart);
+  for (State *s = d->buckets[h & (d->nbuckets - 1)]; s; s = s->chain)
+    if (s->hash == h && s->atStart == atStart && s->npcs == d->nkey &&
+        memcmp(s->pcs, d->key, d->nkey * sizeof(int)) == 0)
+      return s;
+
+  size_t size = sizeof(State) + d->nclasses * sizeof(State *) +
+    d->nkey * sizeof(int);
+  if (d->used + size > d->budget)
+    return NULL;
+
+  State *s = (State *)malloc(size);
+  memset(s->next, 0, d->nclasses * sizeof(State *));
+  s->pcs = (int *)(s->next + d->nclasses);
+  s->hash = h;
+  s->atStart = atStart;
+  s->npcs = d->nkey;
+  memcpy(s->pcs, d->key, d->nkey * sizeof(int));
+
+  // See if the state has matched already, or would if the line ended here.
+  const Instruction *inst = d->prog->inst;
+  s->match = false;
+  d->nset = 0;
+  for (int i = 0; i < s->npcs; i++) {
+    if (inst[s->pcs[i]].op == OP_MATCH)
+      s->match = true;
+    else if (inst[s->pcs[i]].op == OP_EOL)
+      addClosure(d, s->pcs[i] + 1, atStart, true);
+  }
+  s->eolMatch = s->match;
+  for (int i = 0; i < d->nset; i++)
+    if (inst[d->dense[i]].op == OP_MATCH)
+      s->eolMatch = true;
+
+  // A new match is started at every location, so a state with nothing in
+  // it past the start of the line stays that way: every thread a new one
+  // could start has already failed to get anywhere. An anchored DFA never
+  // starts new ones, so it's stuck anywhere.
+  s->dead = s->npcs == 0 && (d->anchored || !atStart);
+  s->skip = s->dead;
+
+  // Add it to the cache.
+  int b = h & (d->nbuckets - 1);
+  s->chain = d->buckets[b];
+  d->buckets[b] = s;
+  s->link = d->states;
+  d->states = s;
+  d->used += size;
+  if (++d->nstates > d->nbuckets)
+    growBuckets(d);
+
+  return s;
+}
+
+/**
+Free every cached state, so the cache can be built up again from scratch.
+*/
+static void flushCache(DFA *d)
+{
+  while (d->states) {
+    State *s = d->states;
+    d->states = s->link;
+    free(s);
+  }
+  memset(d->buckets, 0, d->nbuckets * sizeof(State *));
+  d->nstates = 0;
+  d->used = 0;
+  d->start = NULL;
+  d->midStart = NULL;
+}
+
+/**
+Return the state for starting at the start of a line, or anywhere else in
+it, making it if needed.
+*/
+static State *startState(DFA *d, bool bol)
+{
+  State **start = bol ? &d->start : &d->midStart;
+  if (!*start) {
+    d->nset = 0;
+    addClosure(d, 0, bol, false);
+    makeKey(d);
+    *start = cachedState(d, bol);
+  }
+  return *start;
+}
+
+/**
+Work out which characters take the DFA out of its midStart state, and
+whether there are few enough of them for searches to skip to. Transitions
+that haven't been computed yet count as leaving it, and so does a
+newline, which searches always have to see.
+
+@param d The DFA to work it out for, which has a midStart state.
+*/
+static void buildSkip(DFA *d)
+{
+  State *s = d->midStart;
+  int exits = 0;
+  clearByteSet(&d->skip);
+  for (int c = 0; c < ALPHABET; c++)
+    if (c == '\n' || s->next[d->classOf[c]] != s) {
+      addByte(&d->skip, c);
+      exits++;
+    }
+  s->skip = s->dead || exits <= SKIP_EXITS;
+  d->skips = 0;
+  d->skipped = 0;
+}
+
+/**
+Compute the transition from state s on character c, and cache it.
+
+@param d The DFA s belongs to.
+@param s The state to move from.
+@param c The character to move on.
+@param pos Location of c in the string, for deciding whether to flush.
+@return The next state, or NULL if the DFA should give up on this string.
+*/
+static State *computeNext(DFA *d, State *s, unsigned char c, long pos)
+{
+  const Instruction *inst = d->prog->inst;
+
+  // Step every thread in s over c, just like the Machine would.
+  d->nset = 0;
+  for (int i = 0; i < s->npcs; i++) {
+    const Instruction *in = &inst[s->pcs[i]];
+    if (in->op == OP_ANY ||
+        (in->op == OP_CHAR && (unsigned char)in->sym == c) ||
+        (in->op == OP_CLASS && inByteSet(&d->prog->sets[in->x], c)))
+      addClosure(d, s->pcs[i] + 1, false, false);
+  }
+  // A match could start at the next location too.
+  if (!d->anchored)
+    addClosure(d, 0, false, false);
+  makeKey(d);
+
+  State *t = cachedState(d, false);
+  if (t) {
+    s->next[d->classOf[c]] = t;
+
+    // One less character leaves the state between matches, which might be
+    // few enough to skip to now.
+    if (t == s && s == d->midStart)
+      buildSkip(d);
+    return t;
+  }
+
+  // The cache is full. If it filled up too fast to be worth it, give up.
+  // Otherwise, start it over. The key for t is still there to build from.
+  if (pos - d->flushPos < MIN_PROGRESS * d->nstates)
+    return NULL;
+  flushCache(d);
+  d->flushPos = pos;
+  return cachedState(d, false);
+}
+
+/**
+Split the characters into byte classes, so characters the program can't
+tell apart share a single column in every state's transition table. Each
+character the program tests for on its own, and each set it tests for,
+splits every class into the part inside it and the part outside. A
+newline is always split off too, since searches treat it specially.
+
+@param d The DFA to fill in the classes for.
+*/
+static void splitClasses(DFA *d)
+{
+  const Program *prog = d->prog;
+  memset(d->classOf, 0, sizeof(d->classOf));
+  d->nclasses = 1;
+
+  for (int pc = -1; pc < prog->len; pc++) {
+    // Find the set of characters this instruction tests for, if any.
+    ByteSet set;
+    clearByteSet(&set);
+    if (pc < 0)
+      addByte(&set, '\n');
+    else if (prog->inst[pc].op == OP_CHAR)
+      addByte(&set, prog->inst[pc].sym);
+    else if (prog->inst[pc].op == OP_CLASS)
+      set = prog->sets[prog->inst[pc].x];
+    else
+      continue;
+
+    // Renumber the classes, giving each (class, in set) pair its own.
+    int renumber[ALPHABET][2];
+    memset(renumber, -1, sizeof(renumber));
+    int n = 0;
+    for (int c = 0; c < ALPHABET; c++) {
+      int *id = &renumber[d->classOf[c]][inByteSet(&set, c)];
+      if (*id < 0)
+        *id = n++;
+      d->classOf[c] = *id;
+    }
+    d->nclasses = n;
+  }
+}
+
+DFA *makeDFA(const Program *prog, size_t budget)
+{
+  DFA *d = (DFA *)malloc(sizeof(DFA));
+  d->prog = prog;
+  d->anchored = false;
+  d->budget = budget;
+  d->used = 0;
+  d->start = NULL;
+  d->midStart = NULL;
+  d->states = NULL;
+  d->nstates = 0;
+  d->nbuckets = INITIAL_BUCKETS;
+  d->buckets = (State **)calloc(d->nbuckets, sizeof(State *));
+  splitClasses(d);
+
+  d->dense = (int *)malloc(prog->len * sizeof(int));
+  d->sparse = (int *)calloc(prog->len, sizeof(int));
+  d->nset = 0;
+  d->stack = (int *)malloc((2 * prog->len + 1) * sizeof(int));
+  d->key = (int *)malloc(prog->len * sizeof(int));
+  d->nkey = 0;
+
+  return d;
+}
+
+DFA *makeAnchoredDFA(const Program *prog, size_t budget)
+{
+  DFA *d = makeDFA(prog, budget);
+  d->anchored = true;
+  return d;
+}
+
+int dfaMatch(DFA *d, long len, const char *str)
+{
+  d->flushPos = 0;
+  State *s = startState(d, true);
+  if (!s)
+    return DFA_GAVE_UP;
+
+  for (long pos = 0; pos < len; pos++) {
+    unsigned char c = str[pos];
+    State *t = s->next[d->classOf[c]];
+    // Match states never get transitions, so they only have to be checked
+    // on the way to computing a new one.
+    if (!t) {
+      if (s->match)
+        return DFA_MATCH;
+      if (!(t = computeNext(d, s, c, pos)))
+        return DFA_GAVE_UP;
+    }
+    s = t;
+    if (s->dead)
+      return DFA_NO_MATCH;
+  }
+
+  return s->eolMatch ? DFA_MATCH : DFA_NO_MATCH;
+}
+
+/**
+Return the location of the start of the line containing pos.
+*/
+static long lineStart(const char *buf, long start, long pos)
+{
+  while (pos > start && buf[pos - 1] != '\n')
+    pos--;
+  return pos;
+}
+
+/**
+Find the next character at or after a location that takes the DFA out of
+its midStart state. Even a few characters can be common in the input, so
+skipping is given up on if, after a trial, it isn't getting far enough
+each time.
+
+@param d The DFA, which is in its midStart state.
+@param buf The buffer being searched.
+@param len Length of the buffer.
+@param from Location to skip from.
+@return Location of the next character in the DFA's skip set, or len if
+        there isn't one.
+*/
+static long skipAhead(DFA *d, const char *buf, long len, long from)
+{
+  long i = from;
+  uint64_t hits = 0;
+  while (i < len) {
+    int n = len - i < SCAN_WIDTH ? len - i : SCAN_WIDTH;
+    if ((hits = scanByteSet(&d->skip, buf + i, n)))
+      break;
+    i += n;
+  }
+  if (hits)
+    i += __builtin_ctzll(hits);
+
+  d->skipped += i - from;
+  if (++d->skips == SKIP_TRIAL && d->skipped < SKIP_TRIAL * SKIP_MIN_RUN)
+    d->midStart->skip = false;
+  return i;
+}
+
+int dfaSearch(DFA *d, const char *buf, long len, long *pos)
+{
+  long start = *pos;
+  d->flushPos = start;
+  State *s = startState(d, true);
+  if (!s)
+    return DFA_GAVE_UP;
+  // Make the state between matches, so transitions back to it are known
+  // to be, and searches can skip through it.
+  startState(d, false);
+
+  for (long i = start; i < len; i++) {
+    unsigned char c = buf[i];
+    State *t = s->next[d->classOf[c]];
+    if (!t) {
+      if (s->match || (c == '\n' && s->eolMatch)) {
+        *pos = i;
+        return DFA_MATCH;
+      }
+
+      if (c == '\n') {
+        // The end of a line that didn't match, so start over on the next
+        // one. This transition is cached like any other, unless the cache
+        // has to be flushed to make room for the start state.
+        if ((t = startState(d, true))) {
+          s->next[d->classOf[c]] = t;
+        } else {
+          flushCache(d);
+          d->flushPos = i;
+          t = startState(d, true);
+        }
+      } else {
+        t = computeNext(d, s, c, i);
+      }
+
+      if (!t) {
+        *pos = lineStart(buf, start, i);
+        return DFA_GAVE_UP;
+      }
+    }
+    s = t;
+
+    // Nothing more on this line can match (like past the start of it, for
+    // a pattern that begins with ^), so skip to its newline. Or, between
+    // matches, skip to the next character that could start one, a vector
+    // at a time.
+    if (s->skip) {
+      long next;
+      if (s->dead) {
+        const char *nl = memchr(buf + i + 1, '\n', len - i - 1);
+        next = nl ? nl - buf : len;
+      } else {
+        next = skipAhead(d, buf, len, i + 1);
+      }
+      if (next == len)
+        break;
+      i = next - 1;
+    }
+  }
+
+  // The last line might not end in a newline, so check it here.
+  if (len > start && buf[len - 1] != '\n' && s->eolMatch) {
+    *pos = len - 1;
+    return DFA_MATCH;
+  }
+
+  *pos = len;
+  return DFA_NO_MATCH;
+}
+
+int dfaMatchStarts(DFA *d, long len, const char *str, bool *starts)
+{
+  // The reversed string starts at the end of the line, so that's where
+  // the start state's anchors are satisfied, and the progress counted
+  // for flushing is from there.
+  d->flushPos = 0;
+  State *s = startState(d, true);
+  if (!s)
+    return DFA_GAVE_UP;
+
+  int result = DFA_NO_MATCH;
+  for (long pos = len; ; pos--) {
+    // A match of the reversed program ending here is a match of the
+    // original one starting here.
+    starts[pos] = pos == 0 ? s->eolMatch : s->match;
+    if (starts[pos])
+      result = DFA_MATCH;
+    if (pos == 0)
+      break;
+
+    // Nothing further back can match (like before the end of the line,
+    // for a pattern that ends with $).
+    if (s->dead) {
+      memset(starts, 0, pos);
+      break;
+    }
+
+    unsigned char c = str[pos - 1];
+    State *t = s->next[d->classOf[c]];
+    if (!t && !(t = computeNext(d, s, c, len - pos)))
+      return DFA_GAVE_UP;
+    s = t;
+  }
+
+  return result;
+}
+
+int dfaLongest(DFA *d, long len, const char *str, long pos, long *end)
+{
+  d->flushPos = pos;
+  State *s = startState(d, pos == 0);
+  if (!s)
+    return DFA_GAVE_UP;
+
+  // Keep going until no thread is left, noting the last match on the way.
+  int result = DFA_NO_MATCH;
+  for (; ; pos++) {
+    if (pos == len ? s->eolMatch : s->match) {
+      *end = pos;
+      result = DFA_MATCH;
+    }
+    if (pos == len || s->dead)
+      return result;
+
+    unsigned char c = str[pos];
+    State *t = s->next[d->classOf[c]];
+    if (!t && !(t = computeNext(d, s, c, pos)))
+      return DFA_GAVE_UP;
+    s = t;
+  }
+}
+
+void freeDFA(DFA *d)
+{
+  flushCache(d);
+  free(d->buckets);
+  free(d->dense);
+  free(d->sparse);
+  free(d->stack);
+  free(d->key);
+  free(d);
+}
@@ -0,0 +1,129 @@
+/**
+@file dfa.h
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The dfa.h file contains the interface for a lazily built deterministic
+automaton that matches the same strings as a compiled Program.
+<p>
+Each DFA state stands for the set of program instructions the Machine
+would have as its threads at some location in the string. States and the
+transitions between them are only built the first time a search needs
+them, and are cached, so once the cache is warm matching a line costs one
+table lookup per character. The cache is flushed and started over whenever
+it grows past a memory budget given when the DFA is made.
+<p>
+Besides deciding whether a line matches, DFAs can also find where matches
+are. An ordinary DFA for a program compiled in reverse finds where they
+start, with dfaMatchStarts(), and an anchored DFA for the program itself
+finds where the longest one from a given start ends, with dfaLongest().
+*/
+#ifndef _DFA_H_
+#define _DFA_H_
+
+#include <stddef.h>
+#include "program.h"
+
+/** Result of dfaMatch() when the line contains a match. */
+#define DFA_MATCH 1
+
+/** Result of dfaMatch() when the line doesn't contain a match. */
+#define DFA_NO_MATCH 0
+
+/**
+Result of dfaMatch() when the DFA gave up, because its cache kept filling
+up without making enough progress through the line. The caller should
+match the line some other way (e.g., with a Machine).
+*/
+#define DFA_GAVE_UP -1
+
+/** A short name to use for a lazily built DFA. */
+typedef struct DFATag DFA;
+
+/**
+Make a new DFA for the given program. No states are built until the DFA
+is used to match a string.
+
+@param prog The program this DFA is for. It must outlive the DFA.
+@param budget Number of bytes of cached states the DFA may hold before it
+              flushes its cache.
+@return A dynamically allocated DFA for prog.
+*/
+DFA *makeDFA(const Program *prog, size_t budget);
+
+/**
+Make a new anchored DFA for the given program, which only matches from the
+location it's started at instead of anywhere after it. This is only for
+use with dfaLongest().
+
+@param prog The program this DFA is for. It must outlive the DFA.
+@param budget Number of bytes of cached states the DFA may hold before it
+              flushes its cache.
+@return A dynamically allocated anchored DFA for prog.
+*/
+DFA *makeAnchoredDFA(const Program *prog, size_t budget);
+
+/**
+Report whether the DFA's program matches anywhere in the given string,
+building any states and transitions it needs along the way.
+
+@param d The DFA to run.
+@param len Length of the string.
+@param str The input string being matched against.
+@return DFA_MATCH, DFA_NO_MATCH or DFA_GAVE_UP.
+*/
+int dfaMatch(DFA *d, long len, const char *str);
+
+/**
+Find the first line in a buffer of lines that contains a match, stepping
+across the whole buffer (newlines included) without stopping at each line.
+Lines are separated by newlines, and the last one doesn't need to end with
+a newline.
+
+@param d The DFA to run.
+@param buf The buffer of lines to search.
+@param len Length of the buffer.
+@param pos Location to start searching from, which must be the start of a
+           line. For DFA_MATCH, it's set to a location in the matching line
+           (possibly its newline). For DFA_GAVE_UP, it's set to the start of
+           the line the DFA gave up on. Otherwise, it's set to len.
+@return DFA_MATCH, DFA_NO_MATCH or DFA_GAVE_UP.
+*/
+int dfaSearch(DFA *d, const char *buf, long len, long *pos);
+
+/**
+Find every location in a string where a match starts, by running a DFA for
+a program compiled in reverse backward over it, from its end to its start.
+Wherever the reversed program has matched, a match of the original one
+starts. This takes a single pass, however many matches there are.
+
+@param d A DFA made by makeDFA() for a program compiled in reverse.
+@param len Length of the string.
+@param str The input string being matched against.
+@param starts An array of len + 1 entries, each set to true if a match
+             starts at that location.
+@return DFA_MATCH if any match starts anywhere, DFA_NO_MATCH or
+        DFA_GAVE_UP, in which case starts is only partly filled in.
+*/
+int dfaMatchStarts(DFA *d, long len, const char *str, bool *starts);
+
+/**
+Find where the longest match that starts at a given location ends.
+
+@param d A DFA made by makeAnchoredDFA().
+@param len Length of the string.
+@param str The input string being matched against.
+@param pos Location the match has to start at.
+@param end For DFA_MATCH, set to the location just past the end of the
+           longest match.
+@return DFA_MATCH, DFA_NO_MATCH or DFA_GAVE_UP.
+*/
+int dfaLongest(DFA *d, long len, const char *str, long pos, long *end);
+
+/**
+Free the memory for a DFA and all of its cached states.
+
+@param d The DFA to free.
+*/
+void freeDFA(DFA *d);
+
+#endif
@@ -0,0 +1,349 @@
+/**
+@file literal.c
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The literal.c component computes the literal strings that every match of a
+pattern must start with, end with or contain, along with the exact set of
+strings it matches when that set is small. The rules for combining them
+follow the structure of the pattern: for example, a match of p1 p2 must
+contain whatever p1's matches end with, followed by whatever p2's matches
+start with.
+*/
+
+/* Headers */
+#include "literal.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Constant Definitions */
+#define MAX_EXACT 8192  /* Most strings kept in an exact set */
+
+
+/********************************************************************
+*
+*                          STRING UTILITIES
+*
+********************************************************************/
+/**
+Return a new copy of the first n characters of str.
+*/
+static char *copyString(const char *str, int n)
+{
+  char *s = (char *)malloc(n + 1);
+  memcpy(s, str, n);
+  s[n] = '\0';
+  return s;
+}
+
+/**
+Return a new string holding a followed by b.
+*/
+static char *joinStrings(const char *a, const char *b)
+{
+  int alen = strlen(a), blen = strlen(b);
+  char *s = (char *)malloc(alen + blen + 1);
+  memcpy(s, a, alen);
+  memcpy(s + alen, b, blen + 1);
+  return s;
+}
+
+/**
+Return a new string holding the longest common prefix of a and b.
+*/
+static char *commonPrefix(const char *a, const char *b)
+{
+  int n = 0;
+  while (a[n] && a[n] == b[n])
+    n++;
+  return copyString(a, n);
+}
+
+/**
+Return a new string holding the longest common suffix of a and b.
+*/
+static char *commonSuffix(const char *a, const char *b)
+{
+  int alen = strlen(a), blen = strlen(b);
+  int n = 0;
+  while (n < alen && n < blen && a[alen - n - 1] == b[blen - n - 1])
+    n++;
+  return copyString(a + alen - n, n);
+}
+
+/**
+Return a new string holding the longest substring that's in both a and b.
+*/
+static char *commonSubstring(const char *a, const char *b)
+{
+  int best = 0, bestStart = 0;
+  for (int i = 0; a[i]; i++)
+    for (int j = 0; b[j]; j++) {
+      int n = 0;
+      while (a[i + n] && a[i + n] == b[j + n])
+        n++;
+      if (n > best) {
+        best = n;
+        bestStart = i;
+      }
+    }
+  return copyString(a + bestStart, best);
+}
+
+/**
+Replace *best with candidate if candidate is longer, freeing whichever one
+isn't kept.
+*/
+static void keepLongest(char **best, char *candidate)
+{
+  if (strlen(candidate) > strlen(*best)) {
+    free(*best);
+    *best = candidate;
+  } else {
+    free(candidate);
+  }
+}
+
+
+/********************************************************************
+*
+*                          STRING SET UTILITIES
+*
+********************************************************************/
+/**
+Make set an empty, known set with room for the given number of strings.
+*/
+static void makeSet(StringSet *set, int room)
+{
+  set->count = 0;
+  set->strs = (char **)malloc((room > 0 ? room : 1) * sizeof(char *));
+}
+
+/**
+Make set unknown.
+*/
+static void unknownSet(StringSet *set)
+{
+  set->count = -1;
+  set->strs = NULL;
+}
+
+/**
+Free the strings in a set.
+*/
+static void freeSet(StringSet *set)
+{
+  for (int i = 0; i < set->count; i++)
+    free(set->strs[i]);
+  free(set->strs);
+  unknownSet(set);
+}
+
+/**
+Add a copy of str to a known set that has room for it.
+*/
+static void addString(StringSet *set, const char *str)
+{
+  set->strs[set->count++] = copyString(str, strlen(str));
+}
+
+/**
+Fill in set with every string from a followed by every string from b, or
+make it unknown if that would be too many. The sets a and b are left as
+they are.
+*/
+static void productSet(StringSet *set, const StringSet *a, const StringSet *b)
+{
+  if (a->count < 0 || b->count < 0 ||
+      (long)a->count * b->count > MAX_EXACT) {
+    unknownSet(set);
+    return;
+  }
+
+  makeSet(set, a->count * b->count);
+  for (int i = 0; i < a->count; i++)
+    for (int j = 0; j < b->count; j++)
+      set->strs[set->count++] = joinStrings(a->strs[i], b->strs[j]);
+}
+
+/**
+Move every string in b over to the end of a, or make a unknown if that
+would be too many. Either way, b is left empty and unknown.
+*/
+static void unionSet(StringSet *a, StringSet *b)
+{
+  if (a->count < 0 || b->count < 0 || a->count + b->count > MAX_EXACT) {
+    freeSet(a);
+    freeSet(b);
+    return;
+  }
+
+  a->strs = (char **)realloc(a->strs,
+    (a->count + b->count > 0 ? a->count + b->count : 1) * sizeof(char *));
+  memcpy(a->strs + a->count, b->strs, b->count * sizeof(char *));
+  a->count += b->count;
+  free(b->strs);
+  unknownSet(b);
+}
+
+
+/********************************************************************
+*
+*                          LITERAL FUNCTIONS
+*
+********************************************************************/
+void symbolLiterals(Literals *lit, char sym)
+{
+  // The strings are NUL-terminated, so a NUL can't go in one. Know nothing
+  // about a symbol like that, rather than drop it from every string.
+  if (sym == '\0') {
+    anyLiterals(lit);
+    return;
+  }
+
+  makeSet(&lit->exact, 1);
+  lit->exact.strs[lit->exact.count++] = copyString(&sym, 1);
+  lit->left = copyString(&sym, 1);
+  lit->right = copyString(&sym, 1);
+  lit->in = copyString(&sym, 1);
+  lit->anchored = false;
+}
+
+void anyLiterals(Literals *lit)
+{
+  unknownSet(&lit->exact);
+  lit->left = copyString("", 0);
+  lit->right = copyString("", 0);
+  lit->in = copyString("", 0);
+  lit->anchored = false;
+}
+
+void anchorLiterals(Literals *lit)
+{
+  makeSet(&lit->exact, 1);
+  lit->exact.strs[lit->exact.count++] = copyString("", 0);
+  lit->left = copyString("", 0);
+  lit->right = copyString("", 0);
+  lit->in = copyString("", 0);
+  lit->anchored = true;
+}
+
+void concatLiterals(Literals *lit, Literals *a, Literals *b)
+{
+  productSet(&lit->exact, &a->exact, &b->exact);
+  lit->anchored = a->anchored || b->anchored;
+
+  // Matches start with a's prefix, or with more if a's matches are known.
+  if (a->exact.count > 0) {
+    lit->left = joinStrings(a->exact.strs[0], b->left);
+    for (int i = 1; i < a->exact.count; i++) {
+      char *s = joinStrings(a->exact.strs[i], b->left);
+      char *prefix = commonPrefix(lit->left, s);
+      free(lit->left);
+      free(s);
+      lit->left = prefix;
+    }
+  } else {
+    lit->left = copyString(a->left, strlen(a->left));
+  }
+
+  // And the same for the end, if b's matches are known.
+  if (b->exact.count > 0) {
+    lit->right = joinStrings(a->right, b->exact.strs[0]);
+    for (int i = 1; i < b->exact.count; i++) {
+      char *s = joinStrings(a->right, b->exact.strs[i]);
+      char *suffix = commonSuffix(lit->right, s);
+      free(lit->right);
+      free(s);
+      lit->right = suffix;
+    }
+  } else {
+    lit->right = copyString(b->right, strlen(b->right));
+  }
+
+  // Matches contain anything either part contains, plus whatever spans
+  // the boundary between the two.
+  lit->in = joinStrings(a->right, b->left);
+  keepLongest(&lit->in, copyString(a->in, strlen(a->in)));
+  keepLongest(&lit->in, copyString(b->in, strlen(b->in)));
+  keepLongest(&lit->in, copyString(lit->left, strlen(lit->left)));
+  keepLongest(&lit->in, copyString(lit->right, strlen(lit->right)));
+
+  freeLiterals(a);
+  freeLiterals(b);
+}
+
+void alternateLiterals(Literals *lit, Literals *a, Literals *b)
+{
+  // Take over a's set, so a long list of alternatives isn't copied over
+  // and over as it's built up.
+  lit->exact = a->exact;
+  unknownSet(&a->exact);
+  unionSet(&lit->exact, &b->exact);
+  lit->anchored = a->anchored || b->anchored;
+
+  // Only what both alternatives agree on is certain.
+  lit->left = commonPrefix(a->left, b->left);
+  lit->right = commonSuffix(a->right, b->right);
+  lit->in = commonSubstring(a->in, b->in);
+  keepLongest(&lit->in, copyString(lit->left, strlen(lit->left)));
+  keepLongest(&lit->in, copyString(lit->right, strlen(lit->right)));
+
+  freeLiterals(a);
+  freeLiterals(b);
+}
+
+void repeatLiterals(Literals *lit, Literals *a, int min, int max)
+{
+  lit->anchored = a->anchored;
+
+  // With a limit on repetitions, the exact set is the union of a's set
+  // repeated each allowed number of times.
+  unknownSet(&lit->exact);
+  if (max >= 0 && a->exact.count >= 0) {
+    StringSet power, all;
+    makeSet(&power, 1);
+    addString(&power, "");
+    makeSet(&all, 0);
+    for (int k = 0; k <= max && power.count >= 0 && all.count >= 0; k++) {
+      if (k >= min) {
+        StringSet copy;
+        makeSet(&copy, power.count);
+        for (int i = 0; i < power.count; i++)
+          addString(&copy, power.strs[i]);
+        unionSet(&all, &copy);
+      }
+      if (k < max) {
+        StringSet next;
+        productSet(&next, &power, &a->exact);
+        freeSet(&power);
+        power = next;
+      }
+    }
+    // If the loop stopped early, the set got too big to keep.
+    if (power.count < 0)
+      freeSet(&all);
+    freeSet(&power);
+    lit->exact = all;
+  }
+
+  // A match might have no repetitions at all, so nothing's certain then.
+  if (min == 0) {
+    lit->left = copyString("", 0);
+    lit->right = copyString("", 0);
+    lit->in = copyString("", 0);
+  } else {
+    lit->left = copyString(a->left, strlen(a->left));
+    lit->right = copyString(a->right, strlen(a->right));
+    lit->in = copyString(a->in, strlen(a->in));
+  }
+
+  freeLiterals(a);
+}
+
+void freeLiterals(Literals *lit)
+{
+  freeSet(&lit->exact);
+  free(lit->left);
+  free(lit->right);
+  free(lit->in);
+}
@@ -0,0 +1,98 @@
+/**
+@file literal.h
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The literal.h file contains header components for the analysis that finds
+literal strings a pattern's matches must contain. mygrep uses these to
+skip, with a fast substring search, any part of its input that can't
+possibly match before handing it to a matcher.
+<p>
+Each kind of pattern computes its Literals from the Literals of its
+subpatterns, using the functions declared here.
+*/
+#ifndef _LITERAL_H_
+#define _LITERAL_H_
+
+#include <stdbool.h>
+
+/**
+A set of strings. If the set is too big to keep track of (or infinite),
+count is -1 and there are no strings.
+*/
+typedef struct {
+  int count;          /* Number of strings, or -1 if the set isn't known */
+  char **strs;        /* The strings in the set */
+} StringSet;
+
+/**
+What's known about the literal strings in every match of some pattern.
+Every string is dynamically allocated and owned by the Literals.
+*/
+typedef struct {
+  StringSet exact;    /* Every string the pattern can match, if known */
+  char *left;         /* Every match starts with this */
+  char *right;        /* Every match ends with this */
+  char *in;           /* Every match contains this; the longest one known */
+  bool anchored;      /* True if the pattern contains ^ or $ */
+} Literals;
+
+/**
+Fill in the literals for a pattern that matches exactly one symbol. A NUL
+can't go in the strings, so it's treated like anyLiterals().
+
+@param lit The literals to fill in.
+@param sym The symbol matched.
+*/
+void symbolLiterals(Literals *lit, char sym);
+
+/**
+Fill in the literals for a pattern that matches one character from a set
+too big to be worth tracking, like the one matched by '.'.
+
+@param lit The literals to fill in.
+*/
+void anyLiterals(Literals *lit);
+
+/**
+Fill in the literals for an anchor, which only matches the empty string.
+
+@param lit The literals to fill in.
+*/
+void anchorLiterals(Literals *lit);
+
+/**
+Fill in the literals for the concatenation of two patterns.
+
+@param lit The literals to fill in.
+@param a Literals for the first pattern, freed by this function.
+@param b Literals for the second pattern, freed by this function.
+*/
+void concatLiterals(Literals *lit, Literals *a, Literals *b);
+
+/**
+Fill in the literals for the alternation of two patterns.
+
+@param lit The literals to fill in.
+@param a Literals for the first pattern, freed by this function.
+@param b Literals for the second pattern, freed by this function.
+*/
+void alternateLiterals(Literals *lit, Literals *a, Literals *b);
+
+/**
+Fill in the literals for between min and max repetitions of a pattern.
+
+@param lit The literals to fill in.
+@param a Literals for the repeated pattern, freed by this function.
+@param min Minimum number of repetitions.
+@param max Maximum number of repetitions, or -1 for no limit.
+*/
+void repeatLiterals(Literals *lit, Literals *a, int min, int max);
+
+/**
+Free the strings owned by the given literals.
+
+@param lit The literals to free.
+*/
+void freeLiterals(Literals *lit);
+
+#endif
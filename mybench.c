@@ -0,0 +1,391 @@
+/**
+@file mybench.c
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The mybench program measures how fast libregexer searches. It generates
+large synthetic inputs in memory, then runs a fixed set of patterns over
+each of them with each engine, and prints one line of tab-separated
+results per run, so results from different versions can be compared
+with ordinary text tools.
+<p>
+Each run happens in a child process of its own, so every one starts with
+a cold DFA and its peak memory use can be measured separately. The child
+searches the input several times and reports its best time.
+<p>
+The inputs are:
+<ul>
+<li>log - log-like lines where errors are rare, so few lines match most
+    patterns.</li>
+<li>dense - the same kind of lines, but mostly errors and requests, so
+    most lines match.</li>
+<li>long - lines of random words tens of kilobytes long, with a few
+    distinctive words here and there.</li>
+</ul>
+*/
+
+/* Headers */
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "regexer.h"
+
+/* Constant Definitions */
+#define DEFAULT_MEGABYTES 8  /* Default size of each input */
+#define DEFAULT_REPS 3       /* Default number of searches per run */
+#define LONG_LINE 65536      /* Approximate length of lines in long */
+#define MEGABYTE (1024 * 1024)
+
+/**
+A named engine, selected by turning the others off with RX_ flags.
+*/
+typedef struct {
+  const char *name;         /* Name printed in the results */
+  int flags;                /* Flags for rx_compile() */
+} Engine;
+
+/**
+The result of a single run, sent from the child back to the parent.
+*/
+typedef struct {
+  long lines;               /* Number of lines in the input */
+  long matches;             /* Number of lines that matched */
+  double compile;           /* Seconds taken to compile the pattern */
+  double seconds;           /* Best time for one search of the input */
+} Result;
+
+/**
+Engines to measure. The default picks whichever is fastest; the rest
+force one engine by turning the faster ones off.
+*/
+static const Engine engines[] = {
+  { "auto", 0 },
+  { "dfa", RX_NO_LITERALS },
+  { "bitap", RX_NO_LITERALS | RX_NO_DFA },
+  { "machine", RX_NO_LITERALS | RX_NO_DFA | RX_NO_BITAP },
+  { "marks", RX_NO_LITERALS | RX_MARKS },
+};
+
+/** Patterns to measure. */
+static const char *patterns[] = {
+  "ERROR",
+  "ERROR|FATAL|panic",
+  "took [0-9]+ms$",
+  "^2026-10-1[0-9]T0[0-3]",
+  "(GET|POST|PUT) /api/v[12]/[a-z]+/[0-9]+",
+  "user(1|2)[0-9]* from 10[.]",
+  "[a-q][^u-z][a-q][^u-z][a-q]",
+  "q.*x.*z",
+};
+
+
+/********************************************************************
+*
+*                          INPUT GENERATION
+*
+********************************************************************/
+/**
+A growing buffer of generated input.
+*/
+typedef struct {
+  char *buf;                /* The input generated so far */
+  long len;                 /* Length of the input */
+  long cap;                 /* Capacity of buf */
+} Corpus;
+
+/** State of the pseudo-random number generator, so input is repeatable. */
+static uint64_t seed = 88172645463325252ULL;
+
+/**
+Return the next pseudo-random number, from a xorshift generator.
+
+@param n Number of values to choose from.
+@return A number from 0 to n - 1.
+*/
+static int next(int n)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed % n;
+}
+
+/**
+Add printf-style text to the end of a corpus, growing it if needed.
+
+@param c The corpus to add to.
+@param fmt Format string for the text.
+*/
+static void append(Corpus *c, const char *fmt, ...)
+  __attribute__((format(printf, 2, 3)));
+
+static void append(Corpus *c, const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(c->buf + c->len, c->cap - c->len, fmt, ap);
+  va_end(ap);
+  if (c->len + n >= c->cap) {
+    c->cap = 2 * (c->len + n + 1);
+    c->buf = (char *)realloc(c->buf, c->cap);
+    va_start(ap, fmt);
+    vsnprintf(c->buf + c->len, c->cap - c->len, fmt, ap);
+    va_end(ap);
+  }
+  c->len += n;
+}
+
+/**
+Add a random lowercase word to the end of a corpus.
+
+@param c The corpus to add to.
+*/
+static void appendWord(Corpus *c)
+{
+  char word[12];
+  int n = 2 + next(8);
+  for (int i = 0; i < n; i++)
+    word[i] = 'a' + next(26);
+  word[n] = '\0';
+  append(c, "%s", word);
+}
+
+/**
+Add a log-like line to the end of a corpus: a timestamp, a host and a
+service, then a level and a message, which is sometimes an HTTP request.
+
+@param c The corpus to add to.
+@param errors Percentage of lines that should be errors or requests.
+*/
+static void appendLogLine(Corpus *c, int errors)
+{
+  static const char *services[] = { "sshd", "nginx", "cron", "kernel" };
+  append(c, "2026-10-%02dT%02d:%02d:%02d.%03dZ host-%d %s[%d]: ",
+    1 + next(28), next(24), next(60), next(60), next(1000), next(64),
+    services[next(4)], next(32768));
+
+  if (next(100) < errors) {
+    static const char *methods[] = { "GET", "POST", "PUT", "DELETE" };
+    if (next(2))
+      append(c, "%s %s /api/v%d/", next(5) ? "ERROR" : "FATAL",
+        methods[next(4)], 1 + next(3));
+    else
+      append(c, "INFO %s /api/v%d/", methods[next(4)], 1 + next(3));
+    appendWord(c);
+    append(c, "/%d took %dms\n", next(100000), next(5000));
+  } else {
+    append(c, "%s Accepted publickey for user%d from 10.%d.%d.%d port %d",
+      next(10) ? "INFO" : "WARN", next(1000), next(4), next(256), next(256),
+      1024 + next(60000));
+    if (next(3) == 0)
+      append(c, " took %dms", next(5000));
+    append(c, "\n");
+  }
+}
+
+/**
+Add a very long line of random words to the end of a corpus, with an
+occasional word the patterns look for.
+
+@param c The corpus to add to.
+*/
+static void appendLongLine(Corpus *c)
+{
+  long start = c->len;
+  while (c->len - start < LONG_LINE) {
+    if (next(2000) == 0)
+      append(c, "%s", next(2) ? "ERROR" : "panic");
+    else
+      appendWord(c);
+    append(c, " ");
+  }
+  append(c, "\n");
+}
+
+/**
+Generate one of the inputs.
+
+@param name Name of the input to generate.
+@param size Approximate size of the input, in bytes.
+@return The generated input.
+*/
+static Corpus generate(const char *name, long size)
+{
+  Corpus c = { (char *)malloc(size + 1), 0, size + 1 };
+  while (c.len < size) {
+    if (strcmp(name, "log") == 0)
+      appendLogLine(&c, 2);
+    else if (strcmp(name, "dense") == 0)
+      appendLogLine(&c, 80);
+    else
+      appendLongLine(&c);
+  }
+  return c;
+}
+
+
+/********************************************************************
+*
+*                          MEASUREMENT
+*
+********************************************************************/
+/**
+Return the current time, in seconds, from a clock that only goes forward.
+*/
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+Compile a pattern and search an input with it several times, keeping the
+best time. This runs in the child process.
+
+@param c The input to search.
+@param pattern The pattern to search for.
+@param flags Flags selecting the engine.
+@param reps Number of times to search the input.
+@return The result of the run.
+*/
+static Result measure(const Corpus *c, const char *pattern, int flags,
+  int reps)
+{
+  Result r = { 0, 0, 0, 0 };
+  for (long i = 0; i < c->len; i++)
+    r.lines += c->buf[i] == '\n';
+
+  double t = now();
+  Regex *rx = rx_compile(pattern, flags);
+  r.compile = now() - t;
+
+  for (int i = 0; i < reps; i++) {
+    t = now();
+    long matches = 0;
+    long start = 0, end;
+    while (rx_search(rx, c->buf, c->len, &start, &end)) {
+      matches++;
+      start = end + 1;
+    }
+    t = now() - t;
+    if (i == 0 || t < r.seconds)
+      r.seconds = t;
+    r.matches = matches;
+  }
+
+  rx_free(rx);
+  return r;
+}
+
+/**
+Measure one pattern with one engine over one input in a child process,
+and print a line with the results.
+
+@param corpus Name of the input.
+@param c The input to search.
+@param pattern The pattern to search for.
+@param e The engine to use.
+@param reps Number of times to search the input.
+@return The number of lines that matched, or -1 if the run failed.
+*/
+static long run(const char *corpus, const Corpus *c, const char *pattern,
+  const Engine *e, int reps)
+{
+  int fd[2];
+  if (pipe(fd) != 0) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fd[0]);
+    Result r = measure(c, pattern, e->flags, reps);
+    if (write(fd[1], &r, sizeof(r)) != sizeof(r))
+      _exit(EXIT_FAILURE);
+    _exit(EXIT_SUCCESS);
+  }
+  close(fd[1]);
+
+  Result r;
+  bool ok = read(fd[0], &r, sizeof(r)) == sizeof(r);
+  close(fd[0]);
+  int status;
+  struct rusage usage;
+  wait4(pid, &status, 0, &usage);
+  if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+    fprintf(stderr, "Run failed: %s %s %s\n", corpus, pattern, e->name);
+    return -1;
+  }
+
+  printf("%s\t%s\t%s\t%ld\t%ld\t%ld\t%.1f\t%.6f\t%.2f\t%.0f\t%.3f\t%ld\n",
+    corpus, pattern, e->name, c->len, r.lines, r.matches, r.compile * 1e6,
+    r.seconds, c->len / r.seconds / MEGABYTE, r.lines / r.seconds,
+    r.seconds * 1e9 / c->len, usage.ru_maxrss);
+  return r.matches;
+}
+
+
+/********************************************************************
+*
+*                           MAIN METHOD
+*
+********************************************************************/
+/**
+The main method for the mybench program. It can be given -s megabytes,
+for the size of each input, and -r reps, for the number of times each run
+searches its input.
+
+@param argc The count of command line arguments.
+@param argv The command line arguments array.
+@return The programs successful or unsuccessful exit status.
+*/
+int main(int argc, char *argv[])
+{
+  int megabytes = DEFAULT_MEGABYTES;
+  int reps = DEFAULT_REPS;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:r:")) != -1) {
+    if (opt == 's' && (megabytes = atoi(optarg)) > 0)
+      continue;
+    if (opt == 'r' && (reps = atoi(optarg)) > 0)
+      continue;
+    fprintf(stderr, "usage: mybench [-s megabytes] [-r reps]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  static const char *corpora[] = { "log", "dense", "long" };
+  int npatterns = sizeof(patterns) / sizeof(patterns[0]);
+  int nengines = sizeof(engines) / sizeof(engines[0]);
+
+  printf("corpus\tpattern\tengine\tbytes\tlines\tmatches\tcompile_us\t"
+         "seconds\tmb_per_s\tlines_per_s\tns_per_byte\tpeak_rss_kb\n");
+  for (int i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++) {
+    Corpus c = generate(corpora[i], (long)megabytes * MEGABYTE);
+    for (int p = 0; p < npatterns; p++) {
+      // Every engine should find the same lines, or the numbers mean
+      // nothing.
+      long expected = -1;
+      for (int e = 0; e < nengines; e++) {
+        long matches = run(corpora[i], &c, patterns[p], &engines[e], reps);
+        if (expected < 0)
+          expected = matches;
+        else if (matches >= 0 && matches != expected)
+          fprintf(stderr, "Engines disagree: %s %s %s\n", corpora[i],
+            patterns[p], engines[e].name);
+      }
+    }
+    free(c.buf);
+  }
+
+  return(EXIT_SUCCESS);
+}
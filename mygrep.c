@@ -9,32 +9,58 @@ sets for lines that match a regular expression. After it's started, mygrep just
 needs to read lines from its input until it reaches the end-of-file.
 <p>
 It prints to standard output any line that contains a match for the pattern,
-and ignores lines that don't contain a match.
+and ignores lines that don't contain a match. With -o, it prints just the
+parts of those lines that match instead, each on a line of its own, and
+with -b, it prints the byte offset of each line or part in the input
+before it.
 <p>
 This program limits itself to matching against one input line at a
 time to avoid having to consider patterns that could match the newline
 character. Input lines could be arbitrarily long.
 <p>
 The mygrep.c component contains the main() function. It's responsible for
-handling command-line arguments, parsing the regular expression and matching
-it against lines from the input.
+handling command-line arguments, reading the input and printing the lines
+that match. Parsing and matching the regular expression are left to the
+library interface in regexer.h.
 */
 
 /* Headers */
 #define _GNU_SOURCE
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "pattern.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "regexer.h"
 
 
 /* Constant Definitions */
-// Each CLA below has 1 added to it to account for program at position 0.
-#define ONE_ARG 2   /* Count of args for pattern input only + 1 */
-#define TWO_ARGS 3  /* Count of args when an input file is passed */
+// Each count below is for the args left after any options.
+#define ONE_ARG 1   /* Count of args for pattern input only */
+#define TWO_ARGS 2  /* Count of args when an input file is passed */
+#define BLOCK_SIZE (1024 * 1024)      /* Bytes of input read at a time */
+#define CHUNK_SIZE (4 * 1024 * 1024)  /* Bytes of input per parallel chunk */
+#define CHUNKS_AHEAD 4  /* Chunks each thread may get ahead of the output */
+#define JOBS_PER_CPU 4  /* Most threads to search with for each CPU */
 
-/* Prototoypes */
-//static void testCode();
+/**
+Everything needed to search input for the pattern.
+*/
+typedef struct {
+  const Regex *rx;          /* The compiled pattern, shared by threads */
+  FILE *out;                /* Where matching lines are written */
+  int npats;                /* Number of patterns from a pattern file, or
+                               0 for a single pattern */
+  bool *hits;               /* Which patterns matched the current line */
+  bool only;                /* True to print only the matching parts */
+  bool offsets;             /* True to print byte offsets */
+  long base;                /* Offset in the input of the buffer being
+                               searched */
+  RxSpan *spans;            /* Matches in the current line, for -o */
+  int cap;                  /* Capacity of spans */
+} Searcher;
 
 
 /********************************************************************
@@ -43,19 +69,13 @@ it against lines from the input.
 *
 ********************************************************************/
 /**
-Return true if the given character is ordinary, if it should just
-match occurrences of itself. This returns false for metacharacters
-like '*' that control how patterns are matched.
-
-@param c Character that should be evaluated as ordinary or special.
-@return True if c is not special.
+Print the usage message for invalid arguments, exit unsuccessfully.
 */
-static bool ordinary(char c)
+static void usage()
 {
-  // See if c is on our list of special characters.
-  if (strchr(".^$*?+|()[{", c))
-    return false;
-  return true;
+  fprintf(stderr, "usage: mygrep [-o] [-b] [-j jobs] "
+                  "<pattern | -f pattern-file> [input-file.txt]\n");
+  exit(EXIT_FAILURE);
 }
 
 /**
@@ -68,118 +88,366 @@ static void invalidPattern()
 }
 
 
+/**
+Read a file of regular expressions, one per line. Each pattern is
+numbered by its line in the file, so blank lines are kept, as empty
+patterns that never match.
+
+@param name Name of the file to read.
+@param count Set to the number of lines in the file.
+@return a dynamically allocated array of the patterns, by line.
+*/
+static char **readPatterns(const char *name, int *count)
+{
+  FILE *fp = fopen(name, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "Can't open pattern file: %s\n", name);
+    exit(EXIT_FAILURE);
+  }
+
+  char **lines = NULL;
+  int n = 0;
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+  while ((len = getline(&line, &cap, fp)) >= 0) {
+    if (len > 0 && line[len - 1] == '\n')
+      line[--len] = '\0';
+    lines = (char **)realloc(lines, (n + 1) * sizeof(char *));
+    lines[n++] = line;
+    line = NULL;
+    cap = 0;
+  }
+  free(line);
+  fclose(fp);
+
+  *count = n;
+  return lines;
+}
+
+
 /********************************************************************
 *
-*                          PARSER FUNCTIONS
+*                          SEARCH FUNCTIONS
 *
 ********************************************************************/
-/*
-* Note: The job of the parser is to build a tree of Pattern objects
-* representing the regular expression parsed. The pattern component
-* actually implements these objects, exposing just a constructor for
-* each type of object.
-********************************************************************/
+/**
+Print what goes before a matching line, or part of one: the numbers of
+the patterns that matched the line, if there are several, and the byte
+offset, if it was asked for.
+
+@param s The searcher to use, with s->hits filled in for the line.
+@param offset Offset in the buffer of the line or part.
+*/
+static void printPrefix(Searcher *s, long offset)
+{
+  if (s->npats) {
+    const char *sep = "";
+    for (int i = 0; i < s->npats; i++)
+      if (s->hits[i]) {
+        fprintf(s->out, "%s%d", sep, i + 1);
+        sep = ",";
+      }
+    fputc(':', s->out);
+  }
+  if (s->offsets)
+    fprintf(s->out, "%ld:", s->base + offset);
+}
 
 /**
-Parse regular expression syntax with the 1st-highest precedence level,
-including individual ordinary symbols, start ^ and end $ anchors,
-character classes [], and patterns surrounded by parentheses (pattern).
-
-@param str The string being parsed.
-@param pos A pass-by-reference value for the location in str being
-           parsed, increased as characters from str are parsed.
-@return a dynamically allocated representation of the pattern for the
-        next portion of str.
+Print every part of a line that matches, each on a line of its own.
+
+@param s The searcher to use.
+@param buf The buffer the line is in.
+@param start Location of the line in buf.
+@param end Location of the end of the line, without its newline.
 */
-static Pattern *parseAtomicPattern(char *str, int *pos)
+static void printMatches(Searcher *s, const char *buf, long start, long end)
 {
-  if (ordinary(str[*pos]))
-    return makeSymbolPattern(str[(*pos)++]);
-  else if (str[*pos] == '.')
-    return makeDotPattern(str[(*pos)++]);
-  else if (str[*pos] == '^')
-    return makeStartAnchorPattern(str[(*pos)++]);
-  else if (str[*pos] == '$')
-    return makeEndAnchorPattern(str[(*pos)++]);
-  //else if (str[*pos] == ']')
-  //  return;
-
-  invalidPattern();
-  return NULL; // Just to make the compiler happy.
+  int count = rx_spans(s->rx, buf + start, end - start, s->spans, s->cap);
+  if (count > s->cap) {
+    s->cap = count;
+    s->spans = (RxSpan *)realloc(s->spans, s->cap * sizeof(RxSpan));
+    rx_spans(s->rx, buf + start, end - start, s->spans, s->cap);
+  }
+
+  for (int i = 0; i < count; i++) {
+    printPrefix(s, start + s->spans[i].start);
+    fwrite(buf + start + s->spans[i].start, 1,
+      s->spans[i].end - s->spans[i].start, s->out);
+    fputc('\n', s->out);
+  }
 }
 
 /**
-Parse regular expression syntax with the 2nd-highest precedence. A
-pattern, p, optionally followed by one or more repetition syntax like
-'*', '+' or '?'. If there's no repetition syntax, it just returns the
-pattern object for p.
-
-Uses parseAtomicExpression() to parse whatever pattern needs to
-be repeated. Then, if a pattern like (abc)+ is found, the
-parseAtomicPattern() will take care of parsing the (abc) part, and the
-parseRepetition() will only need to worry about noticing the + afterward.
-
-@param str The string being parsed.
-@param pos A pass-by-reference value for the location in str being
-           parsed,increased as characters from str are parsed.
-@return a dynamically allocated representation of the pattern for the
-        next portion of str.
+Print every line in a buffer that contains a match, or just the parts
+of them that match.
+
+@param s The searcher to use.
+@param buf The buffer of lines to search.
+@param len Length of the buffer. Every line in it ends with a newline,
+           except possibly the last.
 */
-static Pattern *parseRepetition(char *str, int *pos)
+static void searchBuffer(Searcher *s, const char *buf, long len)
 {
-  Pattern *p = parseAtomicPattern(str, pos);
-  return p;
+  long start = 0, end;
+  while (rx_search(s->rx, buf, len, &start, &end)) {
+    // With several patterns, the ones that matched are listed by number
+    // before the line.
+    if (s->npats)
+      rx_which(s->rx, buf + start, end - start, s->hits);
+
+    if (s->only) {
+      printMatches(s, buf, start, end);
+    } else {
+      printPrefix(s, start);
+      fwrite(buf + start, 1, end < len ? end + 1 - start : end - start,
+        s->out);
+    }
+    start = end + 1;
+  }
 }
 
 /**
-Parse regular expression syntax with the 3rd-highest precedence.
-One pattern, p, (optionally) followed by additional patterns
-(concatenation).  If there are no additional patterns, it just
-returns the pattern object for p.
-
-@param str The string being parsed.
-@param pos A pass-by-reference value for the location in str being
-           parsed,increased as characters from str are parsed.
-@return a dynamically allocated representation of the pattern for the
-        next portion of str.
+Print every line from a stream that contains a match, reading it a block
+at a time. Only complete lines are searched; a partial line at the end of
+a block is carried over to the next one, and the buffer grows if a single
+line doesn't fit in it.
+
+@param s The searcher to use.
+@param input The stream to read lines from.
 */
-static Pattern *parseConcatenation(char *str, int *pos)
+static void searchStream(Searcher *s, FILE *input)
 {
-  // Parse the first pattern.
-  Pattern *p1 = parseRepetition(str, pos);
-  // While there are additional patterns, parse them.
-  while (str[*pos] && str[*pos] != '|' && str[*pos] != ')') {
-    Pattern *p2 = parseRepetition(str, pos);
-    // And build a concatenation pattern to match the sequence.
-    p1 = makeConcatenationPattern(p1, p2);
+  size_t cap = BLOCK_SIZE;
+  char *buf = (char *)malloc(cap);
+  size_t len = 0;
+
+  while (true) {
+    size_t n = fread(buf + len, 1, cap - len, input);
+    len += n;
+    if (n == 0) {
+      // End of file, so whatever's left is the last line.
+      searchBuffer(s, buf, len);
+      s->base += len;
+      break;
+    }
+
+    // Search up to the last complete line, and keep the rest for later.
+    char *last = memrchr(buf, '\n', len);
+    if (last) {
+      size_t used = last + 1 - buf;
+      searchBuffer(s, buf, used);
+      s->base += used;
+      memmove(buf, buf + used, len - used);
+      len -= used;
+    } else if (len == cap) {
+      cap *= 2;
+      buf = (char *)realloc(buf, cap);
+    }
   }
 
-  return p1;
+  free(buf);
 }
 
+
+/**
+One piece of a buffer being searched in parallel, along with the output
+from searching it.
+*/
+typedef struct {
+  const char *buf;          /* Start of this chunk, the start of a line */
+  long len;                 /* Length of this chunk, ending with a newline */
+  char *out;                /* Matching lines found in this chunk */
+  size_t outLen;            /* Length of out */
+  bool done;                /* True once out is ready to be written */
+} Chunk;
+
 /**
-Parse regular expression syntax with the lowest precedence (4th). One
-pattern, p, (optionally) followed by additional patterns separated by
-| (alternation). If there are no additional patterns, just returns the
-pattern object for p.
-
-@param str The string being parsed.
-@param pos A pass-by-reference value for the location in str being
-           parsed,increased as characters from str are parsed.
-@return a dynamically allocated representation of the pattern for the
-        next portion of str.
+State shared by the threads searching a buffer in parallel.
 */
-static Pattern *parseAlternation(char *str, int *pos)
+typedef struct {
+  Chunk *chunks;            /* Chunks the buffer is split into */
+  int nchunks;              /* Number of chunks */
+  int next;                 /* Next chunk for a thread to search */
+  int written;              /* Number of chunks written out so far */
+  int window;               /* Most chunks allowed ahead of the output */
+  const Searcher *proto;    /* Searcher settings shared by every thread */
+  pthread_mutex_t lock;     /* Protects next, written and done */
+  pthread_cond_t cond;      /* Signaled when next, written or done change */
+} Pool;
+
+/**
+Thread function for searching chunks from a pool. Each thread writes the
+lines it finds to the chunk's own output buffer.
+
+@param arg The pool to take chunks from.
+@return Always NULL.
+*/
+static void *searchChunks(void *arg)
 {
-  Pattern *p1 = parseConcatenation(str, pos);
-  while (str[*pos] && str[*pos] == '|') {
-    (*pos)++;
-    Pattern *p2 = parseConcatenation(str, pos);
-    p1 = makeAlternationPattern(p1, p2);
+  Pool *pool = (Pool *)arg;
+  Searcher s = *pool->proto;
+  s.hits = (bool *)malloc((s.npats ? s.npats : 1) * sizeof(bool));
+  s.spans = NULL;
+  s.cap = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  while (true) {
+    // Don't get too far ahead of the chunks being written out.
+    while (pool->next < pool->nchunks &&
+           pool->next >= pool->written + pool->window)
+      pthread_cond_wait(&pool->cond, &pool->lock);
+    if (pool->next >= pool->nchunks)
+      break;
+    Chunk *chunk = &pool->chunks[pool->next++];
+    pthread_mutex_unlock(&pool->lock);
+
+    s.out = open_memstream(&chunk->out, &chunk->outLen);
+    s.base = pool->proto->base + (chunk->buf - pool->chunks[0].buf);
+    searchBuffer(&s, chunk->buf, chunk->len);
+    fclose(s.out);
+
+    pthread_mutex_lock(&pool->lock);
+    chunk->done = true;
+    pthread_cond_broadcast(&pool->cond);
   }
-  return p1;
+  pthread_mutex_unlock(&pool->lock);
+
+  free(s.hits);
+  free(s.spans);
+  return NULL;
 }
 
+/**
+Print every line in a buffer that contains a match, using several threads.
+The buffer is split into chunks at line boundaries, threads search chunks
+as they free up, and their output is written in the original order as
+each chunk in turn is finished. If fewer threads can be started than
+asked for, the ones that did start search every chunk between them.
+
+@param s Searcher settings to use for every thread.
+@param jobs Number of threads to search with.
+@param buf The buffer of lines to search.
+@param len Length of the buffer.
+@return False if no thread could be started, so nothing was searched.
+*/
+static bool searchParallel(const Searcher *s, int jobs, const char *buf,
+  long len)
+{
+  Pool pool;
+  pool.nchunks = 0;
+  pool.chunks = (Chunk *)malloc((len / CHUNK_SIZE + 1) * sizeof(Chunk));
+
+  // Split the buffer at the first newline after each CHUNK_SIZE bytes.
+  for (long pos = 0; pos < len; ) {
+    long end = pos + CHUNK_SIZE < len ? pos + CHUNK_SIZE : len;
+    const char *nl = memchr(buf + end - 1, '\n', len - end + 1);
+    end = nl ? nl + 1 - buf : len;
+
+    Chunk *chunk = &pool.chunks[pool.nchunks++];
+    chunk->buf = buf + pos;
+    chunk->len = end - pos;
+    chunk->done = false;
+    pos = end;
+  }
+
+  pool.next = 0;
+  pool.written = 0;
+  pool.window = jobs * CHUNKS_AHEAD;
+  pool.proto = s;
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.cond, NULL);
+
+  pthread_t *threads = (pthread_t *)malloc(jobs * sizeof(pthread_t));
+  int started = 0;
+  while (started < jobs &&
+         pthread_create(&threads[started], NULL, searchChunks, &pool) == 0)
+    started++;
+  if (started == 0) {
+    free(threads);
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.cond);
+    free(pool.chunks);
+    return false;
+  }
+
+  // Write out each chunk's lines in order, as soon as it's done.
+  for (int i = 0; i < pool.nchunks; i++) {
+    Chunk *chunk = &pool.chunks[i];
+    pthread_mutex_lock(&pool.lock);
+    while (!chunk->done)
+      pthread_cond_wait(&pool.cond, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+
+    fwrite(chunk->out, 1, chunk->outLen, s->out);
+    free(chunk->out);
+
+    pthread_mutex_lock(&pool.lock);
+    pool.written++;
+    pthread_cond_broadcast(&pool.cond);
+    pthread_mutex_unlock(&pool.lock);
+  }
+
+  for (int i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
+  pthread_mutex_destroy(&pool.lock);
+  pthread_cond_destroy(&pool.cond);
+  free(pool.chunks);
+  return true;
+}
+
+/**
+Print every line from a regular file that contains a match, by mapping the
+whole file into memory and searching it in place. This avoids copying the
+input through stdio buffers, and lets the page cache feed the DFA directly.
+
+@param s The searcher to use.
+@param jobs Number of threads to search with.
+@param input The file to search.
+@return False if input isn't a regular file that could be mapped, so it
+        still needs to be searched some other way.
+*/
+static bool searchMapped(Searcher *s, int jobs, FILE *input)
+{
+  struct stat st;
+  if (fstat(fileno(input), &st) != 0 || !S_ISREG(st.st_mode) ||
+      st.st_size == 0)
+    return false;
+
+  char *buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+    fileno(input), 0);
+  if (buf == MAP_FAILED)
+    return false;
+  madvise(buf, st.st_size, MADV_SEQUENTIAL);
+
+  if (jobs <= 1 || !searchParallel(s, jobs, buf, st.st_size))
+    searchBuffer(s, buf, st.st_size);
+
+  munmap(buf, st.st_size);
+  return true;
+}
+
+/**
+Parse the number of threads for -j. It has to be a whole number of at
+least 1, and more than JOBS_PER_CPU threads for each CPU are cut down to
+that many, since they'd only wait on each other.
+
+@param value The argument given for -j.
+@return The number of threads to search with.
+*/
+static int parseJobs(const char *value)
+{
+  char *end;
+  long jobs = strtol(value, &end, 10);
+  if (end == value || *end || jobs < 1)
+    usage();
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  long most = JOBS_PER_CPU * (cpus > 0 ? cpus : 1);
+  return jobs < most ? jobs : most;
+}
 
 /********************************************************************
 *
@@ -190,6 +458,11 @@ static Pattern *parseAlternation(char *str, int *pos)
 The main method for the mygrep program. It can be run with either
 one command-line argument or with two. If only one command-line
 argument is given, it will read and match lines from standard input.
+These can be preceded by -j jobs, to search an input file with that
+many threads, by -f pattern-file, to search for every pattern in the
+file instead of one given on the command line, by -o, to print only the
+parts of lines that match, and by -b, to print byte offsets. A -- after
+the options lets the pattern start with a -.
 
 @param argc The count of command line arguments.
 @param argv The command line arguments array.
@@ -198,61 +471,101 @@ argument is given, it will read and match lines from standard input.
 int main(int argc, char *argv[])
 {
   FILE *input = NULL;       /* Input file (if not standard in) */
-  Pattern *pat = NULL;      /* Pattern object to search for */
-  char *str = NULL;         /* Next line read from input */
+  const char *patternFile = NULL; /* File of patterns, if given */
+  char **lines = NULL;      /* Lines of the pattern file */
+  int nlines = 0;           /* Number of entries in lines */
+  Regex *rx = NULL;         /* The compiled pattern, or patterns */
+  int jobs = 1;             /* Number of threads to search with */
+
+  Searcher s = { NULL, stdout, 0, NULL, false, false, 0, NULL, 0 };
+
+  // Handle any options before the pattern. A -- ends them, so a pattern
+  // that starts with - can follow it.
+  int arg = 1;
+  while (arg < argc && argv[arg][0] == '-' && argv[arg][1] &&
+         strchr("jfob-", argv[arg][1])) {
+    char option = argv[arg][1];
+    if (option == '-') {
+      if (argv[arg][2])
+        usage();
+      arg++;
+      break;
+    }
+    if (option == 'o' || option == 'b') {
+      if (argv[arg][2])
+        usage();
+      if (option == 'o')
+        s.only = true;
+      else
+        s.offsets = true;
+      arg++;
+      continue;
+    }
+
+    // The value can be attached (-j4) or the next argument (-j 4).
+    const char *value = argv[arg][2] ? argv[arg] + 2 : argv[++arg];
+    if (!value)
+      usage();
+    if (option == 'j')
+      jobs = parseJobs(value);
+    if (option == 'f')
+      patternFile = value;
+    arg++;
+  }
 
   // If one argument, read and match lines from standard input.
-  // If two, then read and use the input file instead.
-  if (argc == ONE_ARG) {          // Standard input.
+  // If two, then read and use the input file instead. A pattern file
+  // takes the place of the pattern argument.
+  int args = argc - arg + (patternFile ? 1 : 0);
+  if (args == ONE_ARG) {                // Standard input.
     input = stdin;
-  } else if (argc == TWO_ARGS) {  // File input.
-    input = fopen(argv[2], "r");
-    if (input == NULL) {          // Failed input.
-      fprintf(stderr, "Can't open input file: %s\n", argv[2]);
+  } else if (args == TWO_ARGS) {        // File input.
+    input = fopen(argv[argc - 1], "r");
+    if (input == NULL) {                // Failed input.
+      fprintf(stderr, "Can't open input file: %s\n", argv[argc - 1]);
       exit(EXIT_FAILURE);
     }
   } else { // Invalid number of args, exit with status of EXIT_FAILURE.
-      fprintf(stderr, "usage: mygrep <pattern> [input-file.txt]\n");
-      exit(EXIT_FAILURE);
-      }
-
-  // Parse the pattern into a Pattern object.
-  int pos = 0;
-  pat = parseAlternation(argv[1], &pos);
-
-  // Try matching each line, str, of the input text to the pattern.
-  size_t size = 100;
-  str = (char *)malloc(size + 1);
-  while (getline(&str, &size, input) > 0) {
-
-    int len = strlen(str);
-    // Instantiate before[] to necessary length and fill with true.
-    bool *before = (bool *)malloc((len + 1) * sizeof(bool));
-    for (int i = 0; i < len; i++) {
-      before[i] = true;
-    }
-    // Instantiate space for after[] based on before[].
-    bool after[sizeof(before) / sizeof(before[0])];
-
-    // Test code
-    //printf("Before matching: ");
-    //reportMarks(str, before);
-
-    // Perform the pattern match function to match the line str
-    pat->match(pat, strlen(str), str, before, after);
-
-    // Test code
-    //printf("After matching: ");
-    //reportMarks(str, after);
+    usage();
+  }
 
-    // Print out any successful matches.
-    if (str != NULL && isMatch(str, after)) {
-      printf("%s", str);
+  // Compile the pattern, or every pattern in the file together, so lines
+  // that any of them match are found in one pass.
+  if (patternFile) {
+    lines = readPatterns(patternFile, &nlines);
+
+    // A pattern file with no patterns in it can't match anything.
+    bool any = false;
+    for (int i = 0; i < nlines; i++)
+      any = any || lines[i][0];
+    if (!any) {
+      for (int i = 0; i < nlines; i++)
+        free(lines[i]);
+      free(lines);
+      return(EXIT_SUCCESS);
     }
 
+    rx = rx_compile_set(nlines, (const char *const *)lines, 0);
+    s.npats = nlines;
+    s.hits = (bool *)malloc(nlines * sizeof(bool));
+  } else {
+    rx = rx_compile(argv[arg], 0);
   }
-
-  pat->destroy(pat);
+  if (!rx)
+    invalidPattern();
+  s.rx = rx;
+
+  // Search the input for lines that match, right where it's mapped in
+  // memory if it's a regular file, or a block at a time if it's not.
+  if (!searchMapped(&s, jobs, input))
+    searchStream(&s, input);
+
+  free(s.hits);
+  free(s.spans);
+  rx_free(rx);
+  for (int i = 0; i < nlines; i++)
+    free(lines[i]);
+  free(lines);
 
   return(EXIT_SUCCESS);
 }
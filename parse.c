@@ -0,0 +1,313 @@
+/**
+@file parse.c
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The parse.c component implements a recursive descent parser for regular
+expressions, with one function for each level of precedence. Each of them
+returns NULL if its part of the pattern is invalid, and callers pass that
+straight back up, so an invalid pattern is reported by parsePattern()
+returning NULL rather than by exiting.
+<p>
+The job of the parser is to build a tree of Pattern objects representing
+the regular expression parsed. The pattern component actually implements
+these objects, exposing just a constructor for each type of object.
+*/
+
+/* Headers */
+#include "parse.h"
+#include <string.h>
+
+/* Constant Definitions */
+#define MAX_COUNT 1000          /* Most repetitions a count can give */
+#define MAX_INSTRUCTIONS 100000 /* Most instructions a count can make,
+                                   since programs expand it into copies */
+
+/* Prototoypes */
+static Pattern *parseAlternation(Arena *arena, const char *str, int *pos);
+
+
+/********************************************************************
+*
+*                        UTILITY FUNTIONS
+*
+********************************************************************/
+/**
+Return true if the given character is ordinary, if it should just
+match occurrences of itself. This returns false for metacharacters
+like '*' that control how patterns are matched.
+
+@param c Character that should be evaluated as ordinary or special.
+@return True if c is not special.
+*/
+static bool ordinary(char c)
+{
+  // See if c is on our list of special characters.
+  if (strchr(".^$*?+|()[{", c))
+    return false;
+  return true;
+}
+
+
+/********************************************************************
+*
+*                          PARSER FUNCTIONS
+*
+********************************************************************/
+/**
+Parse a character class, like [abc], [a-z] or [^0-9]. A ^ right after
+the [ makes the class match every character that's not listed. A ]
+right after that is just a member of the class, and so is a - at the
+start or end; anywhere else, a - makes a range between the characters
+on either side of it.
+
+@param arena The arena to allocate patterns from.
+@param str The string being parsed.
+@param pos A pass-by-reference value for the location in str being
+           parsed, pointing at the [ to start with.
+@return a representation of the class, or NULL if it's invalid.
+*/
+static Pattern *parseClass(Arena *arena, const char *str, int *pos)
+{
+  ByteSet set;
+  clearByteSet(&set);
+  (*pos)++;
+
+  bool negate = str[*pos] == '^';
+  if (negate)
+    (*pos)++;
+
+  // Members up to the closing ], but one right at the start is a member.
+  int start = *pos;
+  while (str[*pos] != ']' || *pos == start) {
+    if (!str[*pos])
+      return NULL;
+
+    unsigned char lo = str[(*pos)++];
+    unsigned char hi = lo;
+    if (str[*pos] == '-' && str[*pos + 1] && str[*pos + 1] != ']') {
+      hi = str[*pos + 1];
+      *pos += 2;
+      if (hi < lo)
+        return NULL;
+    }
+    for (int c = lo; c <= hi; c++)
+      addByte(&set, c);
+  }
+  (*pos)++;
+
+  if (negate)
+    invertByteSet(&set);
+  return makeClassPattern(arena, &set);
+}
+
+/**
+Parse regular expression syntax with the 1st-highest precedence level,
+including individual ordinary symbols, start ^ and end $ anchors,
+character classes [], and patterns surrounded by parentheses (pattern).
+
+@param arena The arena to allocate patterns from.
+@param str The string being parsed.
+@param pos A pass-by-reference value for the location in str being
+           parsed, increased as characters from str are parsed.
+@return a representation of the pattern for the next portion of str, or
+        NULL if it's invalid.
+*/
+static Pattern *parseAtomicPattern(Arena *arena, const char *str, int *pos)
+{
+  if (ordinary(str[*pos]))
+    return makeSymbolPattern(arena, str[(*pos)++]);
+  else if (str[*pos] == '.')
+    return makeDotPattern(arena, str[(*pos)++]);
+  else if (str[*pos] == '^')
+    return makeStartAnchorPattern(arena, str[(*pos)++]);
+  else if (str[*pos] == '$')
+    return makeEndAnchorPattern(arena, str[(*pos)++]);
+  else if (str[*pos] == '(') {
+    // A whole alternation inside parentheses, which must be closed. It's
+    // a group, so where it matched can be reported.
+    (*pos)++;
+    Pattern *p = parseAlternation(arena, str, pos);
+    if (!p || str[*pos] != ')')
+      return NULL;
+    (*pos)++;
+    return makeGroupPattern(arena, p);
+  }
+  else if (str[*pos] == '[')
+    return parseClass(arena, str, pos);
+
+  return NULL;
+}
+
+/**
+Parse a number in a repetition count, at most MAX_COUNT.
+
+@param str The string being parsed.
+@param pos A pass-by-reference value for the location in str being
+           parsed, pointing at the number to start with.
+@return The number, or -1 if there isn't a valid one.
+*/
+static int parseNumber(const char *str, int *pos)
+{
+  if (str[*pos] < '0' || str[*pos] > '9')
+    return -1;
+
+  int n = 0;
+  while (str[*pos] >= '0' && str[*pos] <= '9') {
+    n = 10 * n + str[(*pos)++] - '0';
+    if (n > MAX_COUNT)
+      return -1;
+  }
+  return n;
+}
+
+/**
+Parse a repetition count, {m} for exactly m repetitions, {m,} for at
+least m, or {m,n} for m to n of them.
+
+@param str The string being parsed.
+@param pos A pass-by-reference value for the location in str being
+           parsed, pointing at the { to start with.
+@param min Set to the fewest repetitions the count allows.
+@param max Set to the most repetitions the count allows, or -1 for no
+           limit.
+@return True if the count is valid.
+*/
+static bool parseCount(const char *str, int *pos, int *min, int *max)
+{
+  (*pos)++;
+  if ((*min = parseNumber(str, pos)) < 0)
+    return false;
+
+  *max = *min;
+  if (str[*pos] == ',') {
+    (*pos)++;
+    if (str[*pos] == '}')
+      *max = -1;
+    else if ((*max = parseNumber(str, pos)) < *min)
+      return false;
+  }
+
+  if (str[*pos] != '}')
+    return false;
+  (*pos)++;
+  return true;
+}
+
+/**
+Parse regular expression syntax with the 2nd-highest precedence. A
+pattern, p, optionally followed by one or more repetition syntax like
+'*', '+', '?' or a count like {2,5}. If there's no repetition syntax, it
+just returns the pattern object for p.
+
+Uses parseAtomicExpression() to parse whatever pattern needs to
+be repeated. Then, if a pattern like (abc)+ is found, the
+parseAtomicPattern() will take care of parsing the (abc) part, and the
+parseRepetition() will only need to worry about noticing the + afterward.
+
+@param arena The arena to allocate patterns from.
+@param str The string being parsed.
+@param pos A pass-by-reference value for the location in str being
+           parsed,increased as characters from str are parsed.
+@return a representation of the pattern for the next portion of str, or
+        NULL if it's invalid.
+*/
+static Pattern *parseRepetition(Arena *arena, const char *str, int *pos)
+{
+  Pattern *p = parseAtomicPattern(arena, str, pos);
+  if (!p)
+    return NULL;
+  // Wrap p in a repetition for each repetition operator after it.
+  while (true) {
+    if (str[*pos] == '*')
+      p = makeStarPattern(arena, p);
+    else if (str[*pos] == '+')
+      p = makePlusPattern(arena, p);
+    else if (str[*pos] == '?')
+      p = makeQMarkPattern(arena, p);
+    else if (str[*pos] == '{') {
+      // A count is a single pattern object, but the program gets a copy of
+      // p for each repetition, so it can't allow too many.
+      int min, max;
+      if (!parseCount(str, pos, &min, &max) ||
+          (long)compiledSize(p) * (max < 0 ? min + 1 : max) > MAX_INSTRUCTIONS)
+        return NULL;
+      p = makeCountedPattern(arena, p, min, max);
+      continue;
+    }
+    else
+      break;
+    (*pos)++;
+  }
+  return p;
+}
+
+/**
+Parse regular expression syntax with the 3rd-highest precedence.
+One pattern, p, (optionally) followed by additional patterns
+(concatenation).  If there are no additional patterns, it just
+returns the pattern object for p.
+
+@param arena The arena to allocate patterns from.
+@param str The string being parsed.
+@param pos A pass-by-reference value for the location in str being
+           parsed,increased as characters from str are parsed.
+@return a representation of the pattern for the next portion of str, or
+        NULL if it's invalid.
+*/
+static Pattern *parseConcatenation(Arena *arena, const char *str, int *pos)
+{
+  // Parse the first pattern.
+  Pattern *p1 = parseRepetition(arena, str, pos);
+  // While there are additional patterns, parse them.
+  while (p1 && str[*pos] && str[*pos] != '|' && str[*pos] != ')') {
+    Pattern *p2 = parseRepetition(arena, str, pos);
+    if (!p2)
+      return NULL;
+    // And build a concatenation pattern to match the sequence.
+    p1 = makeConcatenationPattern(arena, p1, p2);
+  }
+
+  return p1;
+}
+
+/**
+Parse regular expression syntax with the lowest precedence (4th). One
+pattern, p, (optionally) followed by additional patterns separated by
+| (alternation). If there are no additional patterns, just returns the
+pattern object for p.
+
+@param arena The arena to allocate patterns from.
+@param str The string being parsed.
+@param pos A pass-by-reference value for the location in str being
+           parsed,increased as characters from str are parsed.
+@return a representation of the pattern for the next portion of str, or
+        NULL if it's invalid.
+*/
+static Pattern *parseAlternation(Arena *arena, const char *str, int *pos)
+{
+  Pattern *p1 = parseConcatenation(arena, str, pos);
+  while (p1 && str[*pos] == '|') {
+    (*pos)++;
+    Pattern *p2 = parseConcatenation(arena, str, pos);
+    if (!p2)
+      return NULL;
+    p1 = makeAlternationPattern(arena, p1, p2);
+  }
+  return p1;
+}
+
+int parseSize(const char *str)
+{
+  // Each character makes at most two pattern objects.
+  return 2 * strlen(str) + 1;
+}
+
+Pattern *parsePattern(Arena *arena, const char *str)
+{
+  int pos = 0;
+  Pattern *pat = parseAlternation(arena, str, &pos);
+  // Anything left over, like an unmatched ')', makes the pattern invalid.
+  if (pat && str[pos])
+    return NULL;
+  return pat;
+}
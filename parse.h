@@ -0,0 +1,34 @@
+/**
+@file parse.h
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The parse.h file contains the interface for the regular expression parser,
+which turns the text of a pattern into a tree of Pattern objects.
+*/
+#ifndef _PARSE_H_
+#define _PARSE_H_
+
+#include "pattern.h"
+
+/**
+Return the number of pattern objects parsing a regular expression can
+make, so an arena can be made big enough to parse it into.
+
+@param str The regular expression to be parsed.
+@return The most pattern objects parsing str can allocate.
+*/
+int parseSize(const char *str);
+
+/**
+Parse a whole regular expression. Nothing is printed if it's invalid, so
+callers can report the error however they need to.
+
+@param arena The arena to allocate patterns from, with room for at least
+             parseSize(str) of them.
+@param str The regular expression to parse.
+@return A representation of the pattern, allocated from arena, or NULL if
+        str isn't a valid regular expression.
+*/
+Pattern *parsePattern(Arena *arena, const char *str);
+
+#endif
@@ -9,8 +9,16 @@ symbols (SymbolPattern) and for matching concatenated patterns (BinaryPattern).
 
 /* Headers */
 #include "pattern.h"
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+/* Prototypes */
+static bool startAnchored(Pattern *pat);
+static int longestMatch(Pattern *pat);
+static Pattern *prefixPattern(Arena *arena, Pattern *pat);
+static Pattern *ungroup(Pattern *pat);
 
 
 /*******************************************************************************
@@ -19,39 +27,420 @@ symbols (SymbolPattern) and for matching concatenated patterns (BinaryPattern).
 *
 ********************************************************************************/
 
-void reportMarks(const char *str, const bool *marks)
+void setAllMarks(int len, MarkWord *marks)
 {
-  int i = 0;
-  while (str[i]) {
-    printf("%c%c", marks[i] ? '*' : ' ', str[i]);
-    i++;
-  }
-  printf("%c\n", marks[i] ? '*' : ' ');
+  int words = MARK_WORDS(len);
+  for (int w = 0; w < words; w++)
+    marks[w] = ~(MarkWord)0;
+  marks[words - 1] &= MARK_TAIL(len);
+}
+
+void reportMarks(int len, const char *str, const MarkWord *marks)
+{
+  for (int i = 0; i < len; i++)
+    printf("%c%c", GET_MARK(marks, i) ? '*' : ' ', str[i]);
+  printf("%c\n", GET_MARK(marks, len) ? '*' : ' ');
 }
 
-bool isMatch(const char *str, const bool *marks)
+bool isMatch(int len, const MarkWord *marks)
 {
-  for (int i = 0; str[i]; i++)
-    if (marks[i])
+  // Any nonzero word has a marked location, no need to look at bits.
+  for (int w = 0; w < MARK_WORDS(len); w++)
+    if (marks[w])
       return true;
   return false;
 }
 
 /**
-A simple function that can be used to free the memory for any
-pattern that doesn't allocate any additional memory other than the
-struct used to represent it (e.g., if it doesn't contain any
-sub-patterns).
+Move every mark in before forward by one location, a whole word at a
+time, dropping anything that would move past the end of the string.
+
+@param len Length of the string.
+@param before Marks to move forward.
+@param after Marks one location further along.
+*/
+static void shiftMarks(int len, const MarkWord *before, MarkWord *after)
+{
+  int words = MARK_WORDS(len);
+  MarkWord carry = 0;
+  for (int w = 0; w < words; w++) {
+    after[w] = (before[w] << 1) | carry;
+    carry = before[w] >> (MARK_BITS - 1);
+  }
+  after[words - 1] &= MARK_TAIL(len);
+}
+
+/**
+Finish off a mark set early, once a pattern in tail position has marked
+some location in word w, and carry holds the marks moving into the next
+word. Everything after that is cleared, so the set just holds whatever
+was found so far.
+
+@param len Length of the string.
+@param w Index of the last word filled in.
+@param carry Marks for the start of the next word.
+@param after The mark set to finish off.
+*/
+static void stopMarks(int len, int w, MarkWord carry, MarkWord *after)
+{
+  for (w++; w < MARK_WORDS(len); w++) {
+    after[w] = carry;
+    carry = 0;
+  }
+}
+
+Program *compilePattern(Pattern *pat)
+{
+  Program *prog = makeProgram();
+  pat->compile(pat, prog);
+  emitInstruction(prog, OP_MATCH);
+  return prog;
+}
+
+/**
+Return the index of the last pattern in a set, skipping empty entries.
+*/
+static int lastPattern(Pattern **pats, int count)
+{
+  int last = count - 1;
+  while (!pats[last])
+    last--;
+  return last;
+}
+
+/**
+Compile several patterns into one program, forward or in reverse.
+
+@param pats The patterns to compile.
+@param count Number of entries in pats.
+@param reverse True to compile each pattern back to front.
+@param captures True to record where groups match, with OP_SAVE.
+@return A dynamically allocated program for the patterns.
+*/
+static Program *compileSet(Pattern **pats, int count, bool reverse,
+  bool captures)
+{
+  Program *prog = makeProgram();
+  prog->reverse = reverse;
+  prog->captures = captures;
+  int last = lastPattern(pats, count);
+
+  // Each pattern but the last splits off from the chain of patterns, and
+  // they all end in a match of their own.
+  //
+  //       split L1, L2
+  //   L1: <p0>
+  //       match 0
+  //   L2: split L3, L4
+  //   ...
+  for (int i = 0; i <= last; i++) {
+    if (!pats[i])
+      continue;
+
+    int split = -1;
+    if (i < last) {
+      split = emitInstruction(prog, OP_SPLIT);
+      prog->inst[split].x = prog->len;
+    }
+    pats[i]->compile(pats[i], prog);
+    int match = emitInstruction(prog, OP_MATCH);
+    prog->inst[match].x = i;
+    if (split >= 0)
+      prog->inst[split].y = prog->len;
+  }
+
+  return prog;
+}
+
+Program *compilePatternSet(Pattern **pats, int count)
+{
+  return compileSet(pats, count, false, false);
+}
+
+Program *compileReversePatternSet(Pattern **pats, int count)
+{
+  return compileSet(pats, count, true, false);
+}
+
+Program *compileCapturePatternSet(Pattern **pats, int count, int groups)
+{
+  Program *prog = compileSet(pats, count, false, true);
+  prog->nslots = 2 * (groups + 1);
+  return prog;
+}
+
+void patternSetLiterals(Pattern **pats, int count, Literals *lit)
+{
+  bool first = true;
+  for (int i = 0; i < count; i++) {
+    if (!pats[i])
+      continue;
+
+    if (first) {
+      pats[i]->literals(pats[i], lit);
+      first = false;
+    } else {
+      Literals a = *lit, b;
+      pats[i]->literals(pats[i], &b);
+      alternateLiterals(lit, &a, &b);
+    }
+  }
+}
+
+
+/********************************************************************
+*
+*                          ARENA DEFINITION
+*
+********************************************************************/
+/** Alignment for every object allocated from an arena. */
+#define ARENA_ALIGN 16
+
+/** Bytes to allow for each pattern object when sizing a new arena. */
+#define MAX_PATTERN_SIZE 64
+
+/** One contiguous block of memory in an arena. */
+typedef struct BlockTag {
+  struct BlockTag *next;    /* Block that filled up before this one */
+  size_t size;              /* Bytes available in data */
+  size_t used;              /* Bytes of data handed out so far */
+  char *data;               /* Memory patterns are allocated from */
+} Block;
+
+/**
+An arena patterns are allocated from, one bump allocation after another.
+The parser makes patterns in the order they appear in the expression,
+subpatterns before the pattern containing them, so they're laid out in
+memory close to the order match() visits them.
+*/
+struct ArenaTag {
+  Block *blocks;            /* Most recent block first */
+};
+
+/**
+Add a new block with room for at least size bytes to the arena.
+*/
+static void addBlock(Arena *arena, size_t size)
+{
+  Block *block = (Block *)malloc(sizeof(Block) + size + ARENA_ALIGN);
+  block->next = arena->blocks;
+  block->size = size;
+  block->used = 0;
+  // Start the data on an aligned address, just past the header.
+  block->data = (char *)(((size_t)(block + 1) + ARENA_ALIGN - 1) &
+    ~(size_t)(ARENA_ALIGN - 1));
+  arena->blocks = block;
+}
+
+/**
+Allocate size bytes from the arena, adding a bigger block if the current
+one is full.
+*/
+static void *arenaAlloc(Arena *arena, size_t size)
+{
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+  Block *block = arena->blocks;
+  if (block->used + size > block->size) {
+    addBlock(arena, 2 * block->size > size ? 2 * block->size : size);
+    block = arena->blocks;
+  }
+
+  void *p = block->data + block->used;
+  block->used += size;
+  return p;
+}
+
+Arena *makeArena(int nodes)
+{
+  Arena *arena = (Arena *)malloc(sizeof(Arena));
+  arena->blocks = NULL;
+  addBlock(arena, (nodes > 0 ? nodes : 1) * MAX_PATTERN_SIZE);
+  return arena;
+}
+
+void freeArena(Arena *arena)
+{
+  while (arena->blocks) {
+    Block *block = arena->blocks;
+    arena->blocks = block->next;
+    free(block);
+  }
+  free(arena);
+}
+
+
+/********************************************************************
+*
+*                      MATCH CONTEXT DEFINITION
+*
+********************************************************************/
+/** Number of scratch mark sets a new context starts out with. */
+#define INITIAL_SCRATCH 8
+
+/** Length of the start of a long line to try matching first. */
+#define PROBE_LENGTH 1024
+
+/** How many times longer than PROBE_LENGTH a line has to be to try it. */
+#define PROBE_RATIO 16
+
+/**
+Scratch mark sets for matching patterns, handed out like a stack. A
+pattern takes one while it needs somewhere to keep intermediate marks,
+and gives it back before returning, so the sets in use at any moment
+follow the nesting of the patterns being matched.
+*/
+struct MatchContextTag {
+  MarkWord **bufs;          /* Scratch mark sets, each cap words long */
+  int nbufs;                /* Number of scratch mark sets allocated */
+  int used;                 /* Number of them currently taken */
+  int cap;                  /* Words of room in each scratch mark set */
+  bool tail;                /* True while the pattern being matched ends
+                               the whole match, so all it has to leave in
+                               after is one mark if it matches anywhere */
+  int start;                /* Location in the whole string where the
+                               string being matched starts, when it's
+                               just part of it */
+  int end;                  /* Length of the whole string, when just
+                               part of it is being matched */
+};
+
+/**
+Make sure every scratch mark set has room for the marks of a string of
+the given length. Sets only grow, and at least double when they do, so
+a run of lines of similar length doesn't keep reallocating them. What
+the sets held before is lost, so none can be in use.
+
+@param ctx The context to get ready.
+@param len Length of the string about to be matched.
+*/
+static void prepareMarks(MatchContext *ctx, int len)
+{
+  int words = MARK_WORDS(len);
+  if (words <= ctx->cap)
+    return;
+
+  ctx->cap = words > 2 * ctx->cap ? words : 2 * ctx->cap;
+  for (int i = 0; i < ctx->nbufs; i++) {
+    free(ctx->bufs[i]);
+    ctx->bufs[i] = (MarkWord *)malloc(ctx->cap * sizeof(MarkWord));
+  }
+}
+
+/**
+Take a scratch mark set from the context, adding another set to the
+pool if they're all in use. Its contents are left over from whatever
+used it last, so the caller has to fill in every word.
+
+@param ctx The context to take it from.
+@return A mark set with room for the string being matched.
+*/
+static MarkWord *takeMarks(MatchContext *ctx)
+{
+  if (ctx->used == ctx->nbufs) {
+    ctx->nbufs *= 2;
+    ctx->bufs = (MarkWord **)realloc(ctx->bufs,
+      ctx->nbufs * sizeof(MarkWord *));
+    for (int i = ctx->used; i < ctx->nbufs; i++)
+      ctx->bufs[i] = (MarkWord *)malloc(ctx->cap * sizeof(MarkWord));
+  }
+  return ctx->bufs[ctx->used++];
+}
+
+/**
+Give back the scratch mark set most recently taken from the context.
+
+@param ctx The context to give it back to.
+*/
+static void releaseMarks(MatchContext *ctx)
+{
+  ctx->used--;
+}
+
+MatchContext *makeMatchContext()
+{
+  MatchContext *ctx = (MatchContext *)malloc(sizeof(MatchContext));
+  ctx->nbufs = INITIAL_SCRATCH;
+  ctx->used = 0;
+  ctx->tail = false;
+  ctx->start = 0;
+  ctx->end = 0;
+  ctx->cap = 1;
+  ctx->bufs = (MarkWord **)malloc(ctx->nbufs * sizeof(MarkWord *));
+  for (int i = 0; i < ctx->nbufs; i++)
+    ctx->bufs[i] = (MarkWord *)malloc(ctx->cap * sizeof(MarkWord));
+  return ctx;
+}
+
+/**
+Mark the locations a match could start at, before matching a pattern.
 
-@param pat The pattern to free memory for.
+@param len Length of the string.
+@param anchored True if matches can only start at the start of the string.
+@param marks Mark set of MARK_WORDS(len) words to fill in.
 */
-static void destroySimplePattern(Pattern *pat)
+static void seedMarks(int len, bool anchored, MarkWord *marks)
+{
+  if (anchored) {
+    for (int w = 0; w < MARK_WORDS(len); w++)
+      marks[w] = 0;
+    marks[0] = 1;
+  } else {
+    setAllMarks(len, marks);
+  }
+}
+
+bool matchPattern(Pattern *pat, MatchContext *ctx, int len, const char *str)
 {
-  // The concrete type of pat doesn't matter. free() can still
-  // free its memory, given a pointer to the start of it.
-  free(pat);
+  // A match of an unanchored pattern can start anywhere, so every location
+  // is marked before it, but one that begins with ^ can only start at the
+  // start of the line. If its matches can't be longer than some length,
+  // that's as much of the line as it needs to look at.
+  bool anchored = startAnchored(pat);
+  int n = len;
+  if (anchored) {
+    int longest = longestMatch(pat);
+    if (longest >= 0 && longest < len)
+      n = longest;
+  }
+
+  // The pattern matched if any location is marked after it. Which ones
+  // doesn't matter, so the pattern can stop at the first.
+  prepareMarks(ctx, n);
+  MarkWord *before = takeMarks(ctx);
+  MarkWord *after = takeMarks(ctx);
+  ctx->tail = true;
+  ctx->start = 0;
+  ctx->end = len;
+
+  // Every mark found in the start of a line is also there for the whole
+  // line, so on a long line, try just the start of it first. A match near
+  // the start is found without looking at the rest, and a line with no
+  // match only costs a little more than matching it once.
+  bool found = false;
+  if (n >= PROBE_LENGTH * PROBE_RATIO) {
+    seedMarks(PROBE_LENGTH, anchored, before);
+    pat->match(pat, ctx, PROBE_LENGTH, str, before, after);
+    found = isMatch(PROBE_LENGTH, after);
+  }
+  if (!found) {
+    seedMarks(n, anchored, before);
+    pat->match(pat, ctx, n, str, before, after);
+    found = isMatch(n, after);
+  }
+  releaseMarks(ctx);
+  releaseMarks(ctx);
+
+  return found;
 }
 
+void freeMatchContext(MatchContext *ctx)
+{
+  for (int i = 0; i < ctx->nbufs; i++)
+    free(ctx->bufs[i]);
+  free(ctx->bufs);
+  free(ctx);
+}
 
 
 /********************************************************************
@@ -64,10 +453,12 @@ Type of pattern used to represent a single, ordinary symbol, such
 as 'a' or '5'.
 */
 typedef struct {
-  void(*match)(Pattern *pat, int len, const char *str,
-    const bool *before, bool *after);
+  void(*match)(Pattern *pat, MatchContext *ctx, int len, const char *str,
+    const MarkWord *before, MarkWord *after);
 
-  void(*destroy)(Pattern *pat);
+  void(*compile)(Pattern *pat, Program *prog);
+
+  void(*literals)(Pattern *pat, Literals *lit);
 
   char sym;           /* Symbol that the pattern is supposed to match */
 
@@ -76,30 +467,66 @@ typedef struct {
 /**
 Method used to match a SymbolPattern.
 */
-static void matchSymbolPattern(Pattern *pat, int len, const char *str,
-  const bool *before, bool *after)
+static void matchSymbolPattern(Pattern *pat, MatchContext *ctx,
+  int len, const char *str, const MarkWord *before, MarkWord *after)
 {
   // Cast down to the struct type pat really points to.
   SymbolPattern *this = (SymbolPattern *)pat;
 
-  // Mark first position in after as false.
-  after[0] = false;
+  // Keep just the marks right before an occurrence of the symbol, a word
+  // of locations at a time, then move them forward past it. Location i
+  // of a word is before character i of the same run of MARK_BITS, so each
+  // word lines up with one call to the scan kernel.
+  bool tail = ctx->tail;
+  MarkWord carry = 0;
+  for (int w = 0; w < MARK_WORDS(len); w++) {
+    MarkWord marks = before[w];
+    // Words with no marks can't gain any, so skip scanning their characters.
+    if (marks) {
+      int base = w * MARK_BITS;
+      int n = len - base < SCAN_WIDTH ? len - base : SCAN_WIDTH;
+      marks &= scanSymbol(str + base, n, this->sym);
+    }
+    after[w] = (marks << 1) | carry;
+    carry = marks >> (MARK_BITS - 1);
+
+    // At the end of the match, the first mark is all that's needed.
+    if (tail && (after[w] | carry)) {
+      stopMarks(len, w, carry, after);
+      break;
+    }
+  }
+  after[MARK_WORDS(len) - 1] &= MARK_TAIL(len);
+}
 
-  // So move any match in before[] forward by one and set it in after[].
-  for (int i = 0; i < len; i++)
-    // Set next position in after to true if previous position in before
-    // was true and if the symbol in str matches this symbol.
-    after[i + 1] = (before[i] && str[i] == this->sym);
+/**
+Method used to compile a SymbolPattern.
+*/
+static void compileSymbolPattern(Pattern *pat, Program *prog)
+{
+  SymbolPattern *this = (SymbolPattern *)pat;
+  int pc = emitInstruction(prog, OP_CHAR);
+  prog->inst[pc].sym = this->sym;
+}
+
+/**
+Method used to find the literals in a SymbolPattern.
+*/
+static void symbolPatternLiterals(Pattern *pat, Literals *lit)
+{
+  SymbolPattern *this = (SymbolPattern *)pat;
+  symbolLiterals(lit, this->sym);
 }
 
-Pattern *makeSymbolPattern(char sym)
+Pattern *makeSymbolPattern(Arena *arena, char sym)
 {
   // Make an instance of SymbolPattern, and fill in its state.
-  SymbolPattern *this = (SymbolPattern *)malloc(sizeof(SymbolPattern));
+  SymbolPattern *this = (SymbolPattern *)arenaAlloc(arena, sizeof(SymbolPattern));
   this->sym = sym;
 
   this->match = matchSymbolPattern;
-  this->destroy = destroySimplePattern;
+  this->compile = compileSymbolPattern;
+  this->literals = symbolPatternLiterals;
 
   return (Pattern *) this;
 }
@@ -109,28 +536,40 @@ Pattern *makeSymbolPattern(char sym)
 /********************** Begin DOT Pattern *************************
 Method used to match a DotPattern.
 */
-static void matchDotPattern(Pattern *pat, int len, const char *str,
-  const bool *before, bool *after)
+static void matchDotPattern(Pattern *pat, MatchContext *ctx,
+  int len, const char *str, const MarkWord *before, MarkWord *after)
 {
 
-  // Mark first position in after as false.
-  after[0] = false;
+  // Every character matches, so just move any match in before[] forward
+  // by one location.
+  shiftMarks(len, before, after);
+}
 
-  // So move any match in before[] forward by one and set it in after[].
-  for (int i = 0; i < len; i++)
-    // Set next position in after to true if previous position in before
-    // was true and if the symbol in str matches this symbol.
-    after[i + 1] = (before[i] && str[i]);
+/**
+Method used to compile a DotPattern.
+*/
+static void compileDotPattern(Pattern *pat, Program *prog)
+{
+  emitInstruction(prog, OP_ANY);
+}
+
+/**
+Method used to find the literals in a DotPattern.
+*/
+static void dotPatternLiterals(Pattern *pat, Literals *lit)
+{
+  anyLiterals(lit);
 }
 
-Pattern *makeDotPattern(char sym)
+Pattern *makeDotPattern(Arena *arena, char sym)
 {
   // Make an instance of SymbolPattern, and fill in its state.
-  SymbolPattern *this = (SymbolPattern *)malloc(sizeof(SymbolPattern));
+  SymbolPattern *this = (SymbolPattern *)arenaAlloc(arena, sizeof(SymbolPattern));
   this->sym = sym;
 
   this->match = matchDotPattern;
-  this->destroy = destroySimplePattern;
+  this->compile = compileDotPattern;
+  this->literals = dotPatternLiterals;
 
   return (Pattern *) this;
 }
@@ -140,23 +579,44 @@ Pattern *makeDotPattern(char sym)
 /****************** Begin START ANCHOR Pattern ********************
 Method used to match a StartAnchorPattern.
 */
-static void matchStartAnchorPattern(Pattern *pat, int len, const char *str,
-  const bool *before, bool *after)
+static void matchStartAnchorPattern(Pattern *pat, MatchContext *ctx,
+  int len, const char *str, const MarkWord *before, MarkWord *after)
 {
 
-  // Mark first position in after as true for start anchor.
-  after[0] = true;
+  // Only a mark at the very start of the string survives a start anchor,
+  // and not at the start of just part of it.
+  for (int w = 0; w < MARK_WORDS(len); w++)
+    after[w] = 0;
+  if (ctx->start == 0)
+    after[0] = before[0] & 1;
+}
+
+/**
+Method used to find the literals in either anchor pattern.
+*/
+static void anchorPatternLiterals(Pattern *pat, Literals *lit)
+{
+  anchorLiterals(lit);
+}
 
+/**
+Method used to compile a StartAnchorPattern. Run in reverse, the start of
+the line is the last location reached.
+*/
+static void compileStartAnchorPattern(Pattern *pat, Program *prog)
+{
+  emitInstruction(prog, prog->reverse ? OP_EOL : OP_BOL);
 }
 
-Pattern *makeStartAnchorPattern(char sym)
+Pattern *makeStartAnchorPattern(Arena *arena, char sym)
 {
   // Make an instance of SymbolPattern, and fill in its state.
-  SymbolPattern *this = (SymbolPattern *)malloc(sizeof(SymbolPattern));
+  SymbolPattern *this = (SymbolPattern *)arenaAlloc(arena, sizeof(SymbolPattern));
   this->sym = sym;
 
   this->match = matchStartAnchorPattern;
-  this->destroy = destroySimplePattern;
+  this->compile = compileStartAnchorPattern;
+  this->literals = anchorPatternLiterals;
 
   return (Pattern *) this;
 }
@@ -166,33 +626,260 @@ Pattern *makeStartAnchorPattern(char sym)
 /****************** Begin END ANCHOR Pattern ********************
 Method used to match a StartAnchorPattern.
 */
-static void matchEndAnchorPattern(Pattern *pat, int len, const char *str,
-  const bool *before, bool *after)
+static void matchEndAnchorPattern(Pattern *pat, MatchContext *ctx,
+  int len, const char *str, const MarkWord *before, MarkWord *after)
 {
-  // Mark first position in after[] as false.
-  after[0] = false;
-  after[len] = true;
-
-  if (before[len - 1] == false)
-    for (int i = 0; i < len - 1; i++)
-      after[i] = false;
+  // Only a mark at the very end of the string survives an end anchor, and
+  // not at the end of just part of it.
+  for (int w = 0; w < MARK_WORDS(len); w++)
+    after[w] = 0;
+  if (ctx->start + len == ctx->end && GET_MARK(before, len))
+    SET_MARK(after, len);
+}
 
+/**
+Method used to compile an EndAnchorPattern. Run in reverse, the end of the
+line is the first location reached.
+*/
+static void compileEndAnchorPattern(Pattern *pat, Program *prog)
+{
+  emitInstruction(prog, prog->reverse ? OP_BOL : OP_EOL);
 }
 
-Pattern *makeEndAnchorPattern(char sym)
+Pattern *makeEndAnchorPattern(Arena *arena, char sym)
 {
   // Make an instance of SymbolPattern, and fill in its state.
-  SymbolPattern *this = (SymbolPattern *)malloc(sizeof(SymbolPattern));
+  SymbolPattern *this = (SymbolPattern *)arenaAlloc(arena, sizeof(SymbolPattern));
   this->sym = sym;
 
   this->match = matchEndAnchorPattern;
-  this->destroy = destroySimplePattern;
+  this->compile = compileEndAnchorPattern;
+  this->literals = anchorPatternLiterals;
 
   return (Pattern *) this;
 }
 /******************** End END ANCHOR Pattern ********************/
 
 
+/********************************************************************
+*
+*                    CLASS PATTERN DEFINITION
+*
+********************************************************************/
+/** Most members a class can have for its literals to be tracked. */
+#define MAX_CLASS_LITERALS 16
+
+/**
+Type of pattern used to represent a character class, like [a-z] or
+[^0-9], which matches any one character in a set.
+*/
+typedef struct {
+  void(*match)(Pattern *pat, MatchContext *ctx, int len, const char *str,
+    const MarkWord *before, MarkWord *after);
+
+  void(*compile)(Pattern *pat, Program *prog);
+
+  void(*literals)(Pattern *pat, Literals *lit);
+
+  ByteSet set;        /* Characters the pattern is supposed to match */
+
+} ClassPattern;
+
+/**
+Method used to match a ClassPattern. It works just like a SymbolPattern,
+looking each word's characters up in the set instead.
+*/
+static void matchClassPattern(Pattern *pat, MatchContext *ctx,
+  int len, const char *str, const MarkWord *before, MarkWord *after)
+{
+  ClassPattern *this = (ClassPattern *)pat;
+
+  bool tail = ctx->tail;
+  MarkWord carry = 0;
+  for (int w = 0; w < MARK_WORDS(len); w++) {
+    MarkWord marks = before[w];
+    if (marks) {
+      int base = w * MARK_BITS;
+      int n = len - base < SCAN_WIDTH ? len - base : SCAN_WIDTH;
+      marks &= scanByteSet(&this->set, str + base, n);
+    }
+    after[w] = (marks << 1) | carry;
+    carry = marks >> (MARK_BITS - 1);
+
+    // At the end of the match, the first mark is all that's needed.
+    if (tail && (after[w] | carry)) {
+      stopMarks(len, w, carry, after);
+      break;
+    }
+  }
+  after[MARK_WORDS(len) - 1] &= MARK_TAIL(len);
+}
+
+/**
+Method used to compile a ClassPattern.
+*/
+static void compileClassPattern(Pattern *pat, Program *prog)
+{
+  ClassPattern *this = (ClassPattern *)pat;
+  int pc = emitInstruction(prog, OP_CLASS);
+  prog->inst[pc].x = addByteSetToProgram(prog, &this->set);
+}
+
+/**
+Method used to find the literals in a ClassPattern. A small class is
+treated like an alternation of its members, a big one (or one with a NUL,
+which the literal strings can't hold) like '.'.
+*/
+static void classPatternLiterals(Pattern *pat, Literals *lit)
+{
+  ClassPattern *this = (ClassPattern *)pat;
+
+  int count = 0;
+  for (int c = 0; c < 256; c++)
+    count += inByteSet(&this->set, c);
+  if (count == 0 || count > MAX_CLASS_LITERALS || inByteSet(&this->set, 0)) {
+    anyLiterals(lit);
+    return;
+  }
+
+  bool first = true;
+  for (int c = 0; c < 256; c++) {
+    if (!inByteSet(&this->set, c))
+      continue;
+    if (first) {
+      symbolLiterals(lit, c);
+      first = false;
+    } else {
+      Literals a = *lit, b;
+      symbolLiterals(&b, c);
+      alternateLiterals(lit, &a, &b);
+    }
+  }
+}
+
+Pattern *makeClassPattern(Arena *arena, const ByteSet *set)
+{
+  // Make an instance of ClassPattern, and fill in its state.
+  ClassPattern *this = (ClassPattern *)arenaAlloc(arena, sizeof(ClassPattern));
+  this->set = *set;
+
+  this->match = matchClassPattern;
+  this->compile = compileClassPattern;
+  this->literals = classPatternLiterals;
+
+  return (Pattern *) this;
+}
+/*********************** End CLASS Pattern ************************/
+
+
+/********************************************************************
+*
+*                    STRING PATTERN DEFINITION
+*
+********************************************************************/
+/**
+Type of pattern used to represent a run of two or more ordinary symbols,
+like "abc". The parser never makes one; optimizePattern() puts them in
+place of a concatenation of symbols, so the run is matched all at once.
+*/
+typedef struct {
+  void(*match)(Pattern *pat, MatchContext *ctx, int len, const char *str,
+    const MarkWord *before, MarkWord *after);
+
+  void(*compile)(Pattern *pat, Program *prog);
+
+  void(*literals)(Pattern *pat, Literals *lit);
+
+  int len;            /* Number of symbols in the string */
+  char str[];         /* Symbols the pattern is supposed to match */
+
+} StringPattern;
+
+/**
+Method used to match a StringPattern. Marks that aren't right before an
+occurrence of the first symbol are dropped a word at a time, like a
+SymbolPattern, and the rest of the string is only compared at the marks
+that are left.
+*/
+static void matchStringPattern(Pattern *pat, MatchContext *ctx,
+  int len, const char *str, const MarkWord *before, MarkWord *after)
+{
+  StringPattern *this = (StringPattern *)pat;
+
+  for (int w = 0; w < MARK_WORDS(len); w++)
+    after[w] = 0;
+
+  // A match from location i marks location i + this->len, so nothing past
+  // last can start one.
+  int last = len - this->len;
+  for (int w = 0; last >= 0 && w <= last / MARK_BITS; w++) {
+    MarkWord marks = before[w];
+    if (!marks)
+      continue;
+    int base = w * MARK_BITS;
+    int n = len - base < SCAN_WIDTH ? len - base : SCAN_WIDTH;
+    marks &= scanSymbol(str + base, n, this->str[0]);
+
+    while (marks) {
+      int i = base + __builtin_ctzll(marks);
+      marks &= marks - 1;
+      if (i > last)
+        break;
+      if (memcmp(str + i + 1, this->str + 1, this->len - 1) == 0) {
+        SET_MARK(after, i + this->len);
+        // At the end of the match, the first mark is all that's needed.
+        if (ctx->tail)
+          return;
+      }
+    }
+  }
+}
+
+/**
+Method used to compile a StringPattern, one instruction per symbol, in
+reverse for a program that runs that way.
+*/
+static void compileStringPattern(Pattern *pat, Program *prog)
+{
+  StringPattern *this = (StringPattern *)pat;
+  for (int k = 0; k < this->len; k++) {
+    int pc = emitInstruction(prog, OP_CHAR);
+    prog->inst[pc].sym = this->str[prog->reverse ? this->len - 1 - k : k];
+  }
+}
+
+/**
+Method used to find the literals in a StringPattern, the same as for a
+concatenation of its symbols.
+*/
+static void stringPatternLiterals(Pattern *pat, Literals *lit)
+{
+  StringPattern *this = (StringPattern *)pat;
+  symbolLiterals(lit, this->str[0]);
+  for (int k = 1; k < this->len; k++) {
+    Literals a = *lit, b;
+    symbolLiterals(&b, this->str[k]);
+    concatLiterals(lit, &a, &b);
+  }
+}
+
+Pattern *makeStringPattern(Arena *arena, const char *str, int len)
+{
+  // Make an instance of StringPattern, with room for the symbols after it.
+  StringPattern *this = (StringPattern *)arenaAlloc(arena,
+    sizeof(StringPattern) + len);
+  this->len = len;
+  memcpy(this->str, str, len);
+
+  this->match = matchStringPattern;
+  this->compile = compileStringPattern;
+  this->literals = stringPatternLiterals;
+
+  return (Pattern *) this;
+}
+/*********************** End STRING Pattern ***********************/
+
+
 
 
 
@@ -206,25 +893,16 @@ Representation for a type of pattern that just contains two
 sub-patterns (e.g., concatenation).
 */
 typedef struct {
-  void(*match)(Pattern *pat, int len, const char *str,
-    const bool *before, bool *after);
+  void(*match)(Pattern *pat, MatchContext *ctx, int len, const char *str,
+    const MarkWord *before, MarkWord *after);
 
-  void(*destroy)(Pattern *pat);
+  void(*compile)(Pattern *pat, Program *prog);
+
+  void(*literals)(Pattern *pat, Literals *lit);
 
   Pattern *p1, *p2;         /* Pointer to one of two sub-patterns */
 } BinaryPattern;
 
-// BinaryPattern destroy function implementation
-static void destroyBinaryPattern(Pattern *pat)
-{
-  // Cast down to the struct type pat really points to.
-  BinaryPattern *this = (BinaryPattern *)pat;
-
-  // Free the two subpatterns, then free the struct.
-  this->p1->destroy(this->p1);
-  this->p2->destroy(this->p2);
-  free(this);
-}
 
 
 
@@ -232,30 +910,68 @@ static void destroyBinaryPattern(Pattern *pat)
 Match function for a BinaryPattern used to handle concatenation
 and compute a new set of marked locations.
 */
-static void matchConcatenationPattern(Pattern *pat, int len, const char *str,
-  const bool *before, bool *after)
+static void matchConcatenationPattern(Pattern *pat, MatchContext *ctx,
+  int len, const char *str, const MarkWord *before, MarkWord *after)
 {
 
   // Cast down to the struct type pat really points to.
   BinaryPattern *this = (BinaryPattern *)pat;
 
-  // Temporary storage for the marks after matching the first sub-pattern.
-  bool midMarks[len + 1];
+  // Temporary storage for the marks after matching the first sub-pattern,
+  // borrowed from the context rather than put on the stack.
+  MarkWord *midMarks = takeMarks(ctx);
+
+  // Match each of the sub-patterns in order. The first one needs all of
+  // its marks, since the second goes on from them, and if it doesn't leave
+  // any, neither can the second.
+  bool tail = ctx->tail;
+  ctx->tail = false;
+  this->p1->match(this->p1, ctx, len, str, before, midMarks);
+  ctx->tail = tail;
+  if (isMatch(len, midMarks))
+    this->p2->match(this->p2, ctx, len, str, midMarks, after);
+  else
+    for (int w = 0; w < MARK_WORDS(len); w++)
+      after[w] = 0;
+  releaseMarks(ctx);
+}
+
+/**
+Compile function for a concatenation, just the instructions for the
+first sub-pattern followed by the ones for the second, or the other way
+around for a program that runs in reverse.
+*/
+static void compileConcatenationPattern(Pattern *pat, Program *prog)
+{
+  BinaryPattern *this = (BinaryPattern *)pat;
+  Pattern *first = prog->reverse ? this->p2 : this->p1;
+  Pattern *second = prog->reverse ? this->p1 : this->p2;
+  first->compile(first, prog);
+  second->compile(second, prog);
+}
 
-  // Match each of the sub-patterns in order.
-  this->p1->match(this->p1, len, str, before, midMarks);
-  this->p2->match(this->p2, len, str, midMarks, after);
+/**
+Literals function for a concatenation.
+*/
+static void concatenationPatternLiterals(Pattern *pat, Literals *lit)
+{
+  BinaryPattern *this = (BinaryPattern *)pat;
+  Literals a, b;
+  this->p1->literals(this->p1, &a);
+  this->p2->literals(this->p2, &b);
+  concatLiterals(lit, &a, &b);
 }
 
-Pattern *makeConcatenationPattern(Pattern *p1, Pattern *p2)
+Pattern *makeConcatenationPattern(Arena *arena, Pattern *p1, Pattern *p2)
 {
   // Make an instance of BinaryPattern and fill in its fields.
-  BinaryPattern *this = (BinaryPattern *)malloc(sizeof(BinaryPattern));
+  BinaryPattern *this = (BinaryPattern *)arenaAlloc(arena, sizeof(BinaryPattern));
   this->p1 = p1;
   this->p2 = p2;
 
   this->match = matchConcatenationPattern;
-  this->destroy = destroyBinaryPattern;
+  this->compile = compileConcatenationPattern;
+  this->literals = concatenationPatternLiterals;
 
   return (Pattern *) this;
 }
@@ -266,32 +982,76 @@ Pattern *makeConcatenationPattern(Pattern *p1, Pattern *p2)
 Match function for a BinaryPattern used to handle alternation
 and compute a new set of marked locations.
 */
-static void matchAlternationPattern(Pattern *pat, int len, const char *str,
-  const bool *before, bool *after)
+static void matchAlternationPattern(Pattern *pat, MatchContext *ctx,
+  int len, const char *str, const MarkWord *before, MarkWord *after)
 {
 
   // Cast down to the struct type pat really points to.
   BinaryPattern *this = (BinaryPattern *)pat;
 
-  // Temporary storage for the marks after matching each subpattern.
-  //bool afterMarks[len + 1];
+  // Temporary storage for the marks after matching the second subpattern.
+  MarkWord *altMarks = takeMarks(ctx);
 
-  // Match each of the sub-patterns without one affecting the others marks.
-  this->p1->match(this->p1, len, str, before, after);
-  if (!isMatch(str, after))
-    this->p2->match(this->p2, len, str, before, after);
+  // Match each of the sub-patterns without one affecting the others marks,
+  // then combine them a word at a time. At the end of the match, the
+  // second one isn't needed if the first one matched.
+  this->p1->match(this->p1, ctx, len, str, before, after);
+  if (ctx->tail && isMatch(len, after)) {
+    releaseMarks(ctx);
+    return;
+  }
+  this->p2->match(this->p2, ctx, len, str, before, altMarks);
+  for (int w = 0; w < MARK_WORDS(len); w++)
+    after[w] |= altMarks[w];
+  releaseMarks(ctx);
 
 }
 
-Pattern *makeAlternationPattern(Pattern *p1, Pattern *p2)
+/**
+Compile function for an alternation. It splits into the instructions
+for each sub-pattern, and the first one jumps past the second when done.
+
+      split L1, L2
+  L1: <p1>
+      jmp L3
+  L2: <p2>
+  L3:
+*/
+static void compileAlternationPattern(Pattern *pat, Program *prog)
+{
+  BinaryPattern *this = (BinaryPattern *)pat;
+
+  int split = emitInstruction(prog, OP_SPLIT);
+  prog->inst[split].x = prog->len;
+  this->p1->compile(this->p1, prog);
+  int jmp = emitInstruction(prog, OP_JMP);
+  prog->inst[split].y = prog->len;
+  this->p2->compile(this->p2, prog);
+  prog->inst[jmp].x = prog->len;
+}
+
+/**
+Literals function for an alternation.
+*/
+static void alternationPatternLiterals(Pattern *pat, Literals *lit)
+{
+  BinaryPattern *this = (BinaryPattern *)pat;
+  Literals a, b;
+  this->p1->literals(this->p1, &a);
+  this->p2->literals(this->p2, &b);
+  alternateLiterals(lit, &a, &b);
+}
+
+Pattern *makeAlternationPattern(Arena *arena, Pattern *p1, Pattern *p2)
 {
   // Make an instance of BinaryPattern and fill in its fields.
-  BinaryPattern *this = (BinaryPattern *)malloc(sizeof(BinaryPattern));
+  BinaryPattern *this = (BinaryPattern *)arenaAlloc(arena, sizeof(BinaryPattern));
   this->p1 = p1;
   this->p2 = p2;
 
   this->match = matchAlternationPattern;
-  this->destroy = destroyBinaryPattern;
+  this->compile = compileAlternationPattern;
+  this->literals = alternationPatternLiterals;
 
   return (Pattern *) this;
 }
@@ -309,23 +1069,226 @@ Representation for a type of pattern that contains a repetition of
 another sub-pattern.
 */
 typedef struct {
-  void(*match)(Pattern *pat, int len, const char *str,
-    const bool *before, bool *after);
+  void(*match)(Pattern *pat, MatchContext *ctx, int len, const char *str,
+    const MarkWord *before, MarkWord *after);
+
+  void(*compile)(Pattern *pat, Program *prog);
 
-  void(*destroy)(Pattern *pat);
+  void(*literals)(Pattern *pat, Literals *lit);
 
   Pattern *p;       /* Pointer to subpattern for this repetition */
+  int reach;        /* Longest match p can have, or -1 for no limit */
+  Pattern *prefix;  /* Matches the start of any match of p, when there's
+                       no limit on their length, or NULL */
+  bool single;      /* True if p matches one character from set */
+  ByteSet set;      /* Characters p matches, if single */
 } RepitPattern;
 
-// Destroy function used for RepitPattern.
-static void destroyRepitPattern(Pattern *p)
+/**
+Work out whether a pattern always matches exactly one character, like a
+symbol, '.' or a class, and which characters it matches if so. Any number
+of repetitions of those can be counted instead of matched one at a time.
+
+@param p The pattern to look at.
+@param set Set to the characters p matches, if it's a single character.
+@return True if p matches exactly one character.
+*/
+static bool singleCharacter(Pattern *p, ByteSet *set)
 {
-  // Cast down to the struct type pat really points to.
-  RepitPattern *this = (RepitPattern *)p;
+  p = ungroup(p);
+  clearByteSet(set);
+  if (p->match == matchSymbolPattern)
+    addByte(set, ((SymbolPattern *)p)->sym);
+  else if (p->match == matchDotPattern)
+    invertByteSet(set);
+  else if (p->match == matchClassPattern)
+    *set = ((ClassPattern *)p)->set;
+  else
+    return false;
+  return true;
+}
+
+/**
+Fill in the fields every repetition of a subpattern has, working out
+what the subpattern can match so it can be repeated quickly.
 
-  // Free the subpattern, then free the struct.
-  this->p->destroy(this->p);
-  free(this);
+@param arena The arena to allocate the new pattern from.
+@param this The repetition to fill in.
+@param p The subpattern it repeats.
+*/
+static void initRepetition(Arena *arena, RepitPattern *this, Pattern *p)
+{
+  this->p = p;
+  this->reach = longestMatch(p);
+  this->prefix = this->reach < 0 ? prefixPattern(arena, p) : NULL;
+  this->single = singleCharacter(p, &this->set);
+}
+
+/**
+Match from min to max repetitions of a single character with one pass
+over the string, counting as it goes instead of matching the character
+once per repetition. Location j is reached if some marked location i is
+at least min and at most max characters before it, and every character
+between them is in the set, so all it takes is the length of the run of
+characters from the set that ends at j, and the closest marked location
+at least min characters back.
+
+@param set The characters that can be repeated.
+@param min Fewest repetitions allowed.
+@param max Most repetitions allowed, or -1 for no limit.
+@param tail True if the first location reached is all that's needed.
+@param len Length of the string.
+@param str The input string being matched against.
+@param before Marks for locations before the repetitions.
+@param after Marks for locations after them.
+*/
+static void countRuns(const ByteSet *set, int min, int max, bool tail,
+  int len, const char *str, const MarkWord *before, MarkWord *after)
+{
+  if (max < 0)
+    max = INT_MAX;
+  int run = 0;
+  int last = -1;
+  for (int w = 0; w < MARK_WORDS(len); w++) {
+    // Characters are looked up in the set a word at a time, like any class,
+    // and character j goes on the run for location j + 1.
+    int base = w * MARK_BITS;
+    int n = len - base < SCAN_WIDTH ? len - base : SCAN_WIDTH;
+    uint64_t chars = n > 0 ? scanByteSet(set, str + base, n) : 0;
+    int locs = len - base < MARK_BITS - 1 ? len - base + 1 : MARK_BITS;
+
+    MarkWord marks = 0;
+    for (int b = 0; b < locs; b++) {
+      int j = base + b;
+      if (j >= min && GET_MARK(before, j - min))
+        last = j - min;
+      int reach = run < max ? run : max;
+      marks |= (MarkWord)(last >= 0 && j - last <= reach) << b;
+      run = (run + 1) & -(int)((chars >> b) & 1);
+    }
+    after[w] = marks;
+
+    // At the end of the match, the first mark is all that's needed.
+    if (tail && marks) {
+      stopMarks(len, w, 0, after);
+      return;
+    }
+  }
+}
+
+/**
+Match a subpattern from just the marks in one word of a mark set, looking
+at no more of the string than matches starting there can reach. That part
+of the string is matched on its own, with the context keeping track of
+where it really starts, so anchors still only match at the ends of the
+whole string.
+<p>
+When there's no limit on how long a match can be, the part looked at
+starts out short, and grows until nothing that starts in the word is
+still being matched at the end of it, which the prefix pattern tells.
+Every mark found in part of a string is also there for the whole of it,
+so none of the marks from the shorter part are ever wrong, just missing.
+If the part has to go all the way to the end of the string, the marks in
+every word after w are matched from too, since that costs no more.
+
+@param rep The repetition the subpattern is from.
+@param ctx The context to match with.
+@param len Length of the string.
+@param str The input string being matched against.
+@param marks Marks to match the subpattern from. The ones it's matched
+             from are cleared.
+@param w Index of the first word of marks to match from.
+@param after Set to the marks reached, starting with the ones in word w.
+@return The number of words of after filled in. The rest are empty.
+*/
+static int matchWindow(RepitPattern *rep, MatchContext *ctx, int len,
+  const char *str, MarkWord *marks, int w, MarkWord *after)
+{
+  int base = w * MARK_BITS;
+  int rest = len - base;
+  int n = rest;
+  if (rep->reach >= 0 && rep->reach < rest - MARK_BITS)
+    n = MARK_BITS + rep->reach;
+
+  // Only the first word of before has marks, and the rest are cleared as
+  // the part grows.
+  MarkWord *before = takeMarks(ctx);
+  before[0] = marks[w];
+  int clear = 1;
+
+  int start = ctx->start;
+  ctx->start += base;
+  if (rep->prefix) {
+    for (long reach = MARK_BITS; ; reach *= 4) {
+      n = reach < rest - MARK_BITS ? MARK_BITS + reach : rest;
+      for (; clear < MARK_WORDS(n); clear++)
+        before[clear] = 0;
+      if (n == rest)
+        break;
+      rep->prefix->match(rep->prefix, ctx, n, str + base, before, after);
+      if (!GET_MARK(after, n))
+        break;
+    }
+  }
+  for (; clear < MARK_WORDS(n); clear++)
+    before[clear] = 0;
+  marks[w] = 0;
+  if (n == rest)
+    for (int k = 1; k < MARK_WORDS(n); k++) {
+      before[k] = marks[w + k];
+      marks[w + k] = 0;
+    }
+
+  rep->p->match(rep->p, ctx, n, str + base, before, after);
+  ctx->start = start;
+
+  releaseMarks(ctx);
+  return MARK_WORDS(n);
+}
+
+/**
+Add every location that can be reached by matching any number of
+repetitions of a subpattern to a mark set. The marks still to be matched
+from are worked through from left to right, like a worklist, and only
+locations that weren't already marked are added to it, so no location is
+ever matched from twice. Each word of them is matched on its own, over
+just the part of the string its matches can reach, so the whole job
+takes time in proportion to the length of the string, rather than a pass
+over all of it for each repetition.
+
+@param rep The repetition to match.
+@param ctx The context to match with.
+@param len Length of the string.
+@param str The input string being matched against.
+@param marks Marks to start the repetitions from, and to add to.
+*/
+static void repeatMarks(RepitPattern *rep, MatchContext *ctx, int len,
+  const char *str, MarkWord *marks)
+{
+  int words = MARK_WORDS(len);
+  MarkWord *todo = takeMarks(ctx);
+  MarkWord *reached = takeMarks(ctx);
+  for (int w = 0; w < words; w++)
+    todo[w] = marks[w];
+
+  // Whatever the subpattern reaches is only ever followed by more
+  // repetitions.
+  bool tail = ctx->tail;
+  ctx->tail = false;
+  for (int w = 0; w < words; w++) {
+    while (todo[w]) {
+      int n = matchWindow(rep, ctx, len, str, todo, w, reached);
+      for (int k = 0; k < n; k++) {
+        MarkWord fresh = reached[k] & ~marks[w + k];
+        marks[w + k] |= fresh;
+        todo[w + k] |= fresh;
+      }
+    }
+  }
+  ctx->tail = tail;
+
+  releaseMarks(ctx);
+  releaseMarks(ctx);
 }
 
 
@@ -334,27 +1297,64 @@ static void destroyRepitPattern(Pattern *p)
 Match function for a RepitPattern used to handle zero or more
 repetitions of a subpattern and compute a new set of marked locations.
 */
-static void matchStarPattern(Pattern *pat, int len, const char *str,
-  const bool *before, bool *after)
+static void matchStarPattern(Pattern *pat, MatchContext *ctx,
+  int len, const char *str, const MarkWord *before, MarkWord *after)
 {
-
   // Cast down to the struct type pat really points to.
   RepitPattern *this = (RepitPattern *)pat;
+  if (this->single) {
+    countRuns(&this->set, 0, -1, ctx->tail, len, str, before, after);
+    return;
+  }
 
-  // From the before array, compute all locations in the string, str,
-  // that could be reached after going on to match subpattern, pat.
+  // Zero repetitions leave every mark where it was. At the end of the
+  // match, that's already enough.
+  for (int w = 0; w < MARK_WORDS(len); w++)
+    after[w] = before[w];
+  if (!ctx->tail)
+    repeatMarks(this, ctx, len, str, after);
+}
+
+/**
+Compile function for zero or more repetitions of a subpattern.
 
+  L1: split L2, L3
+  L2: <p>
+      jmp L1
+  L3:
+*/
+static void compileStarPattern(Pattern *pat, Program *prog)
+{
+  RepitPattern *this = (RepitPattern *)pat;
 
+  int split = emitInstruction(prog, OP_SPLIT);
+  prog->inst[split].x = prog->len;
+  this->p->compile(this->p, prog);
+  int jmp = emitInstruction(prog, OP_JMP);
+  prog->inst[jmp].x = split;
+  prog->inst[split].y = prog->len;
+}
+
+/**
+Literals function for zero or more repetitions of a subpattern.
+*/
+static void starPatternLiterals(Pattern *pat, Literals *lit)
+{
+  RepitPattern *this = (RepitPattern *)pat;
+  Literals a;
+  this->p->literals(this->p, &a);
+  repeatLiterals(lit, &a, 0, -1);
 }
 
-Pattern *makeStarPattern(Pattern *p)
+Pattern *makeStarPattern(Arena *arena, Pattern *p)
 {
   // Make an instance of RepitPattern and fill in its fields.
-  RepitPattern *this = (RepitPattern *)malloc(sizeof(RepitPattern));
-  this->p = p;
+  RepitPattern *this = (RepitPattern *)arenaAlloc(arena, sizeof(RepitPattern));
+  initRepetition(arena, this, p);
 
   this->match = matchStarPattern;
-  this->destroy = destroyRepitPattern;
+  this->compile = compileStarPattern;
+  this->literals = starPatternLiterals;
 
   return (Pattern *) this;
 }
@@ -370,26 +1370,61 @@ It should leave a mark at every location that could be the end of a
 match. So, on the input string "abbb", the pattern "ab+" should leave
 marks at " a b*b*b*"
 */
-static void matchPlusPattern(Pattern *pat, int len, const char *str,
-  const bool *before, bool *after)
+static void matchPlusPattern(Pattern *pat, MatchContext *ctx,
+  int len, const char *str, const MarkWord *before, MarkWord *after)
 {
   // Cast down to the struct type pat really points to.
   RepitPattern *this = (RepitPattern *)pat;
+  if (this->single) {
+    countRuns(&this->set, 1, -1, ctx->tail, len, str, before, after);
+    return;
+  }
 
-  // From the before array, compute all locations in the string, str,
-  // that could be reached after going on to match subpattern, pat.
+  // One repetition, then any number more. At the end of the match, one is
+  // already enough.
+  this->p->match(this->p, ctx, len, str, before, after);
+  if (!ctx->tail)
+    repeatMarks(this, ctx, len, str, after);
+}
+
+/**
+Compile function for one or more repetitions of a subpattern.
 
+  L1: <p>
+      split L1, L2
+  L2:
+*/
+static void compilePlusPattern(Pattern *pat, Program *prog)
+{
+  RepitPattern *this = (RepitPattern *)pat;
+
+  int start = prog->len;
+  this->p->compile(this->p, prog);
+  int split = emitInstruction(prog, OP_SPLIT);
+  prog->inst[split].x = start;
+  prog->inst[split].y = prog->len;
+}
 
+/**
+Literals function for one or more repetitions of a subpattern.
+*/
+static void plusPatternLiterals(Pattern *pat, Literals *lit)
+{
+  RepitPattern *this = (RepitPattern *)pat;
+  Literals a;
+  this->p->literals(this->p, &a);
+  repeatLiterals(lit, &a, 1, -1);
 }
 
-Pattern *makePlusPattern(Pattern *p)
+Pattern *makePlusPattern(Arena *arena, Pattern *p)
 {
   // Make an instance of RepPattern and fill in its fields.
-  RepitPattern *this = (RepitPattern *)malloc(sizeof(RepitPattern));
-  this->p = p;
+  RepitPattern *this = (RepitPattern *)arenaAlloc(arena, sizeof(RepitPattern));
+  initRepetition(arena, this, p);
 
-  this->match = matchStarPattern;
-  this->destroy = destroyRepitPattern;
+  this->match = matchPlusPattern;
+  this->compile = compilePlusPattern;
+  this->literals = plusPatternLiterals;
 
   return (Pattern *) this;
 }
@@ -401,22 +1436,998 @@ Pattern *makePlusPattern(Pattern *p)
 Match function for a RepitPatter used to handle either zero or one
 repetitions of a subpattern and compute a new set of marked locations.
 */
-static void matchQMarkPattern(Pattern *pat, int len, const char *str,
-  const bool *before, bool *after)
+static void matchQMarkPattern(Pattern *pat, MatchContext *ctx,
+  int len, const char *str, const MarkWord *before, MarkWord *after)
 {
   // Cast down to the struct type pat really points to.
   RepitPattern *this = (RepitPattern *)pat;
+
+  // Zero repetitions leave every mark where it was, and at the end of the
+  // match, one of those is enough. Otherwise, add the marks from one.
+  if (ctx->tail && isMatch(len, before)) {
+    for (int w = 0; w < MARK_WORDS(len); w++)
+      after[w] = before[w];
+    return;
+  }
+  this->p->match(this->p, ctx, len, str, before, after);
+  for (int w = 0; w < MARK_WORDS(len); w++)
+    after[w] |= before[w];
+}
+
+/**
+Compile function for zero or one repetition of a subpattern.
+
+      split L1, L2
+  L1: <p>
+  L2:
+*/
+static void compileQMarkPattern(Pattern *pat, Program *prog)
+{
+  RepitPattern *this = (RepitPattern *)pat;
+
+  int split = emitInstruction(prog, OP_SPLIT);
+  prog->inst[split].x = prog->len;
+  this->p->compile(this->p, prog);
+  prog->inst[split].y = prog->len;
+}
+
+/**
+Literals function for zero or one repetition of a subpattern.
+*/
+static void qMarkPatternLiterals(Pattern *pat, Literals *lit)
+{
+  RepitPattern *this = (RepitPattern *)pat;
+  Literals a;
+  this->p->literals(this->p, &a);
+  repeatLiterals(lit, &a, 0, 1);
 }
 
-Pattern *makeQMarkPattern(Pattern *p)
+Pattern *makeQMarkPattern(Arena *arena, Pattern *p)
 {
   // Make an instance of RepitPattern and fill in its fields.
-  RepitPattern *this = (RepitPattern *)malloc(sizeof(RepitPattern));
+  RepitPattern *this = (RepitPattern *)arenaAlloc(arena, sizeof(RepitPattern));
   this->p = p;
 
-  this->match = matchStarPattern;
-  this->destroy = destroyRepitPattern;
+  this->match = matchQMarkPattern;
+  this->compile = compileQMarkPattern;
+  this->literals = qMarkPatternLiterals;
 
   return (Pattern *) this;
 }
 /*********************** End QMARK Pattern *************************/
+
+
+/******************** Begin COUNTED Pattern ************************/
+/** Most repetitions of a single character matched a pass at a time. */
+#define COUNT_UNROLL 8
+
+/**
+Representation for a counted repetition of a subpattern, like a{3},
+a{2,} or a{2,5}. It's a single object however many repetitions it allows,
+so a pattern like .{1,1000} doesn't turn into a thousand of them. It
+starts with the same fields as a RepitPattern, so it can be repeated the
+same way.
+*/
+typedef struct {
+  void(*match)(Pattern *pat, MatchContext *ctx, int len, const char *str,
+    const MarkWord *before, MarkWord *after);
+
+  void(*compile)(Pattern *pat, Program *prog);
+
+  void(*literals)(Pattern *pat, Literals *lit);
+
+  Pattern *p;       /* Pointer to subpattern for this repetition */
+  int reach;        /* Longest match p can have, or -1 for no limit */
+  Pattern *prefix;  /* Matches the start of any match of p, when there's
+                       no limit on their length, or NULL */
+  bool single;      /* True if p matches one character from set */
+  ByteSet set;      /* Characters p matches, if single */
+
+  int min;          /* Fewest repetitions allowed */
+  int max;          /* Most repetitions allowed, or -1 for no limit */
+} CountedPattern;
+
+/**
+Match function for a counted repetition of a subpattern. The required
+repetitions are matched one after another, then each optional one only
+goes on from locations that weren't already reached with fewer, since
+anything they lead to has been found already. That stops as soon as a
+repetition reaches nothing new, however high the limit is. With no limit,
+the rest are just like p*.
+*/
+static void matchCountedPattern(Pattern *pat, MatchContext *ctx,
+  int len, const char *str, const MarkWord *before, MarkWord *after)
+{
+  CountedPattern *this = (CountedPattern *)pat;
+  if (this->single && (this->max < 0 || this->max > COUNT_UNROLL)) {
+    countRuns(&this->set, this->min, this->max, ctx->tail, len, str, before,
+      after);
+    return;
+  }
+
+  int words = MARK_WORDS(len);
+  MarkWord *cur = takeMarks(ctx);
+  MarkWord *next = takeMarks(ctx);
+  for (int w = 0; w < words; w++)
+    cur[w] = before[w];
+
+  // Every repetition but the last is followed by another.
+  bool tail = ctx->tail;
+  ctx->tail = false;
+  bool live = true;
+  for (int k = 0; k < this->min && live; k++) {
+    this->p->match(this->p, ctx, len, str, cur, next);
+    MarkWord *tmp = cur;
+    cur = next;
+    next = tmp;
+    live = isMatch(len, cur);
+  }
+  for (int w = 0; w < words; w++)
+    after[w] = cur[w];
+
+  // At the end of the match, any location reached so far is enough.
+  if (tail)
+    live = false;
+  if (live && this->max < 0) {
+    repeatMarks((RepitPattern *)this, ctx, len, str, after);
+    live = false;
+  }
+  for (int k = this->min; live && (this->max < 0 || k < this->max); k++) {
+    this->p->match(this->p, ctx, len, str, cur, next);
+    live = false;
+    for (int w = 0; w < words; w++) {
+      next[w] &= ~after[w];
+      after[w] |= next[w];
+      live |= next[w] != 0;
+    }
+    MarkWord *tmp = cur;
+    cur = next;
+    next = tmp;
+  }
+  ctx->tail = tail;
+
+  releaseMarks(ctx);
+  releaseMarks(ctx);
+}
+
+/**
+Compile function for a counted repetition. Unlike the pattern object,
+the program needs a copy of the subpattern for each repetition: the
+required ones one after another, then either a loop like p*, or a chain
+of optional copies that each skip to the end.
+
+      <p>              (min times)
+      split L1, L3
+  L1: <p>
+      split L2, L3
+  L2: <p>
+  L3:
+*/
+static void compileCountedPattern(Pattern *pat, Program *prog)
+{
+  CountedPattern *this = (CountedPattern *)pat;
+
+  for (int k = 0; k < this->min; k++)
+    this->p->compile(this->p, prog);
+
+  if (this->max < 0) {
+    int split = emitInstruction(prog, OP_SPLIT);
+    prog->inst[split].x = prog->len;
+    this->p->compile(this->p, prog);
+    int jmp = emitInstruction(prog, OP_JMP);
+    prog->inst[jmp].x = split;
+    prog->inst[split].y = prog->len;
+    return;
+  }
+
+  // Until the end is known, each split's y links back to the one before.
+  int last = -1;
+  for (int k = this->min; k < this->max; k++) {
+    int split = emitInstruction(prog, OP_SPLIT);
+    prog->inst[split].x = prog->len;
+    prog->inst[split].y = last;
+    last = split;
+    this->p->compile(this->p, prog);
+  }
+  while (last >= 0) {
+    int prev = prog->inst[last].y;
+    prog->inst[last].y = prog->len;
+    last = prev;
+  }
+}
+
+/**
+Literals function for a counted repetition of a subpattern.
+*/
+static void countedPatternLiterals(Pattern *pat, Literals *lit)
+{
+  CountedPattern *this = (CountedPattern *)pat;
+  Literals a;
+  this->p->literals(this->p, &a);
+  repeatLiterals(lit, &a, this->min, this->max);
+}
+
+Pattern *makeCountedPattern(Arena *arena, Pattern *p, int min, int max)
+{
+  // Make an instance of CountedPattern and fill in its fields.
+  CountedPattern *this = (CountedPattern *)arenaAlloc(arena,
+    sizeof(CountedPattern));
+  initRepetition(arena, (RepitPattern *)this, p);
+  this->min = min;
+  this->max = max;
+
+  this->match = matchCountedPattern;
+  this->compile = compileCountedPattern;
+  this->literals = countedPatternLiterals;
+
+  return (Pattern *) this;
+}
+/********************** End COUNTED Pattern ************************/
+
+
+/********************* Begin GROUP Pattern *************************/
+/**
+Representation for a parenthesized subpattern, which matches just what
+the subpattern does, but also records where it matched in programs
+compiled for finding submatches.
+*/
+typedef struct {
+  void(*match)(Pattern *pat, MatchContext *ctx, int len, const char *str,
+    const MarkWord *before, MarkWord *after);
+
+  void(*compile)(Pattern *pat, Program *prog);
+
+  void(*literals)(Pattern *pat, Literals *lit);
+
+  Pattern *p;       /* Pointer to the subpattern in the parentheses */
+  int index;        /* Number of the group, from 1, by the order of the
+                       opening parentheses */
+} GroupPattern;
+
+/**
+Match function for a GroupPattern, which just matches the subpattern.
+*/
+static void matchGroupPattern(Pattern *pat, MatchContext *ctx,
+  int len, const char *str, const MarkWord *before, MarkWord *after)
+{
+  GroupPattern *this = (GroupPattern *)pat;
+  this->p->match(this->p, ctx, len, str, before, after);
+}
+
+/**
+Compile function for a group. Only programs for finding submatches record
+where it starts and ends; everything else just gets the subpattern.
+
+      save 2 * index
+      <p>
+      save 2 * index + 1
+*/
+static void compileGroupPattern(Pattern *pat, Program *prog)
+{
+  GroupPattern *this = (GroupPattern *)pat;
+  if (prog->captures) {
+    int save = emitInstruction(prog, OP_SAVE);
+    prog->inst[save].x = 2 * this->index;
+  }
+  this->p->compile(this->p, prog);
+  if (prog->captures) {
+    int save = emitInstruction(prog, OP_SAVE);
+    prog->inst[save].x = 2 * this->index + 1;
+  }
+}
+
+/**
+Literals function for a group, the same as its subpattern's.
+*/
+static void groupPatternLiterals(Pattern *pat, Literals *lit)
+{
+  GroupPattern *this = (GroupPattern *)pat;
+  this->p->literals(this->p, lit);
+}
+
+Pattern *makeGroupPattern(Arena *arena, Pattern *p)
+{
+  // Make an instance of GroupPattern and fill in its fields. It's only
+  // numbered once the whole pattern has been parsed.
+  GroupPattern *this = (GroupPattern *)arenaAlloc(arena, sizeof(GroupPattern));
+  this->p = p;
+  this->index = 0;
+
+  this->match = matchGroupPattern;
+  this->compile = compileGroupPattern;
+  this->literals = groupPatternLiterals;
+
+  return (Pattern *) this;
+}
+/*********************** End GROUP Pattern *************************/
+
+
+/********************************************************************
+*
+*                         PATTERN ANALYSIS
+*
+********************************************************************/
+/*
+* Note: These look at the type of each pattern object, which is told
+* apart by its match method, so they have to come after every type.
+********************************************************************/
+
+/**
+Return the pattern inside any number of groups, which match just what it
+does.
+
+@param pat The pattern to look at.
+@return The first pattern inside pat that isn't a group.
+*/
+static Pattern *ungroup(Pattern *pat)
+{
+  while (pat->match == matchGroupPattern)
+    pat = ((GroupPattern *)pat)->p;
+  return pat;
+}
+
+/**
+Return true if every match of a pattern has to start at the start of the
+line, like ^abc or ^a|^b. This is conservative, so it may return false
+for some patterns that are anchored anyway.
+
+@param pat The pattern to look at.
+@return True if pat can only match at the start of the line.
+*/
+static bool startAnchored(Pattern *pat)
+{
+  pat = ungroup(pat);
+  if (pat->match == matchStartAnchorPattern)
+    return true;
+
+  if (pat->match == matchConcatenationPattern)
+    return startAnchored(((BinaryPattern *)pat)->p1);
+
+  if (pat->match == matchAlternationPattern) {
+    BinaryPattern *this = (BinaryPattern *)pat;
+    return startAnchored(this->p1) && startAnchored(this->p2);
+  }
+
+  if (pat->match == matchPlusPattern)
+    return startAnchored(((RepitPattern *)pat)->p);
+
+  if (pat->match == matchCountedPattern) {
+    CountedPattern *this = (CountedPattern *)pat;
+    return this->min > 0 && startAnchored(this->p);
+  }
+
+  return false;
+}
+
+/**
+Return the length of the longest string a pattern can match.
+
+@param pat The pattern to look at.
+@return The most characters a match of pat can have, or -1 if there's no
+        limit (or it's not known).
+*/
+static int longestMatch(Pattern *pat)
+{
+  pat = ungroup(pat);
+  if (pat->match == matchSymbolPattern || pat->match == matchDotPattern ||
+      pat->match == matchClassPattern)
+    return 1;
+
+  if (pat->match == matchStartAnchorPattern ||
+      pat->match == matchEndAnchorPattern)
+    return 0;
+
+  if (pat->match == matchStringPattern)
+    return ((StringPattern *)pat)->len;
+
+  if (pat->match == matchConcatenationPattern ||
+      pat->match == matchAlternationPattern) {
+    BinaryPattern *this = (BinaryPattern *)pat;
+    int a = longestMatch(this->p1);
+    int b = longestMatch(this->p2);
+    if (a < 0 || b < 0)
+      return -1;
+    if (pat->match == matchConcatenationPattern)
+      return a + b;
+    return a > b ? a : b;
+  }
+
+  // Repeating something that can only match the empty string still only
+  // matches the empty string.
+  if (pat->match == matchStarPattern || pat->match == matchPlusPattern)
+    return longestMatch(((RepitPattern *)pat)->p) == 0 ? 0 : -1;
+
+  if (pat->match == matchQMarkPattern)
+    return longestMatch(((RepitPattern *)pat)->p);
+
+  if (pat->match == matchCountedPattern) {
+    CountedPattern *this = (CountedPattern *)pat;
+    int a = longestMatch(this->p);
+    if (a == 0 || this->max == 0)
+      return 0;
+    if (a < 0 || this->max < 0 || a > INT_MAX / this->max)
+      return -1;
+    return a * this->max;
+  }
+
+  return -1;
+}
+
+/**
+Make a pattern that matches the start of any match of another, up to
+any location it passes through, including where it starts and ends. It
+may match a little more than that, but never less, so if it can't reach
+some location, no match of the other can get there or past it.
+
+@param arena The arena to allocate the new pattern from.
+@param pat The pattern to match the starts of matches of.
+@return A pattern for the start of any match of pat.
+*/
+static Pattern *prefixPattern(Arena *arena, Pattern *pat)
+{
+  pat = ungroup(pat);
+  // The start of a concatenation is the start of p1, or all of p1 and the
+  // start of p2.
+  if (pat->match == matchConcatenationPattern) {
+    BinaryPattern *this = (BinaryPattern *)pat;
+    return makeAlternationPattern(arena, prefixPattern(arena, this->p1),
+      makeConcatenationPattern(arena, this->p1,
+        prefixPattern(arena, this->p2)));
+  }
+
+  if (pat->match == matchAlternationPattern) {
+    BinaryPattern *this = (BinaryPattern *)pat;
+    return makeAlternationPattern(arena, prefixPattern(arena, this->p1),
+      prefixPattern(arena, this->p2));
+  }
+
+  // Repetitions are some number of whole ones, then the start of another.
+  if (pat->match == matchStarPattern)
+    return makeConcatenationPattern(arena, pat,
+      prefixPattern(arena, ((RepitPattern *)pat)->p));
+
+  if (pat->match == matchPlusPattern) {
+    Pattern *p = prefixPattern(arena, ((RepitPattern *)pat)->p);
+    return makeAlternationPattern(arena, p,
+      makeConcatenationPattern(arena, pat, p));
+  }
+
+  if (pat->match == matchQMarkPattern)
+    return prefixPattern(arena, ((RepitPattern *)pat)->p);
+
+  if (pat->match == matchCountedPattern) {
+    CountedPattern *this = (CountedPattern *)pat;
+    if (this->max == 0)
+      return pat;
+    return makeConcatenationPattern(arena,
+      makeCountedPattern(arena, this->p, 0,
+        this->max < 0 ? -1 : this->max - 1),
+      prefixPattern(arena, this->p));
+  }
+
+  // The start of a string is some run of its symbols from the first.
+  if (pat->match == matchStringPattern) {
+    StringPattern *this = (StringPattern *)pat;
+    Pattern *p = NULL;
+    for (int k = this->len - 1; k >= 0; k--) {
+      Pattern *sym = makeSymbolPattern(arena, this->str[k]);
+      p = makeQMarkPattern(arena,
+        p ? makeConcatenationPattern(arena, sym, p) : sym);
+    }
+    return p;
+  }
+
+  // Anchors don't match any characters, so they're their own start.
+  if (pat->match == matchStartAnchorPattern ||
+      pat->match == matchEndAnchorPattern)
+    return pat;
+
+  // A single character, or nothing yet.
+  return makeQMarkPattern(arena, pat);
+}
+
+int compiledSize(Pattern *pat)
+{
+  if (pat->match == matchConcatenationPattern)
+    return compiledSize(((BinaryPattern *)pat)->p1) +
+      compiledSize(((BinaryPattern *)pat)->p2);
+
+  if (pat->match == matchAlternationPattern)
+    return compiledSize(((BinaryPattern *)pat)->p1) +
+      compiledSize(((BinaryPattern *)pat)->p2) + 2;
+
+  if (pat->match == matchStarPattern || pat->match == matchPlusPattern ||
+      pat->match == matchQMarkPattern)
+    return compiledSize(((RepitPattern *)pat)->p) + 2;
+
+  if (pat->match == matchCountedPattern) {
+    CountedPattern *this = (CountedPattern *)pat;
+    long size = compiledSize(this->p);
+    size = this->max < 0 ? size * this->min + size + 2 :
+      size * this->min + (size + 1) * (this->max - this->min);
+    return size < INT_MAX ? size : INT_MAX;
+  }
+
+  // A group records where it starts and ends, when compiled for that.
+  if (pat->match == matchGroupPattern)
+    return compiledSize(((GroupPattern *)pat)->p) + 2;
+
+  // A string is an instruction per symbol.
+  if (pat->match == matchStringPattern)
+    return ((StringPattern *)pat)->len;
+
+  // Everything else is a single instruction.
+  return 1;
+}
+
+/**
+Number the groups in a pattern, and any inside them, in the order their
+opening parentheses come in. Subpatterns come in the order of their text,
+except that a group comes before anything inside it.
+
+@param pat The pattern to number the groups in.
+@param count Number of groups already numbered.
+@return Number of groups numbered, including the ones in pat.
+*/
+static int numberFrom(Pattern *pat, int count)
+{
+  if (pat->match == matchGroupPattern) {
+    GroupPattern *this = (GroupPattern *)pat;
+    this->index = ++count;
+    return numberFrom(this->p, count);
+  }
+
+  if (pat->match == matchConcatenationPattern ||
+      pat->match == matchAlternationPattern) {
+    BinaryPattern *this = (BinaryPattern *)pat;
+    return numberFrom(this->p2, numberFrom(this->p1, count));
+  }
+
+  if (pat->match == matchStarPattern || pat->match == matchPlusPattern ||
+      pat->match == matchQMarkPattern || pat->match == matchCountedPattern)
+    return numberFrom(((RepitPattern *)pat)->p, count);
+
+  return count;
+}
+
+int numberGroups(Pattern *pat)
+{
+  return numberFrom(pat, 0);
+}
+
+
+/********************************************************************
+*
+*                        PATTERN OPTIMIZATION
+*
+********************************************************************/
+/**
+A growable list of patterns, for the subpatterns of a chain of
+concatenations or alternations.
+*/
+typedef struct {
+  Pattern **items;          /* Patterns in the list */
+  int count;                /* Number of patterns in the list */
+  int cap;                  /* Capacity of items */
+} PatternList;
+
+/**
+Add a pattern to the end of a list.
+
+@param list The list to add to.
+@param p The pattern to add.
+*/
+static void addToList(PatternList *list, Pattern *p)
+{
+  if (list->count >= list->cap) {
+    list->cap = list->cap ? 2 * list->cap : 8;
+    list->items = (Pattern **)realloc(list->items,
+      list->cap * sizeof(Pattern *));
+  }
+  list->items[list->count++] = p;
+}
+
+/**
+Add the subpatterns of a chain of concatenations, or of alternations, to
+a list, in the order they come in. Anything else is added as it is.
+
+@param pat The pattern to flatten.
+@param alternation True to flatten alternations, false for
+                   concatenations.
+@param list The list to add the subpatterns to.
+*/
+static void flatten(Pattern *pat, bool alternation, PatternList *list)
+{
+  if (pat->match == (alternation ? matchAlternationPattern :
+                                   matchConcatenationPattern)) {
+    BinaryPattern *this = (BinaryPattern *)pat;
+    flatten(this->p1, alternation, list);
+    flatten(this->p2, alternation, list);
+  } else {
+    addToList(list, pat);
+  }
+}
+
+/**
+Return the number of symbols in a pattern that's just a literal, a
+symbol or a string.
+
+@param pat The pattern to look at.
+@return The length of the literal, or 0 if pat isn't one.
+*/
+static int literalLength(Pattern *pat)
+{
+  if (pat->match == matchSymbolPattern)
+    return 1;
+  if (pat->match == matchStringPattern)
+    return ((StringPattern *)pat)->len;
+  return 0;
+}
+
+/**
+Return the symbols of a pattern that's just a literal.
+
+@param pat A symbol or a string.
+@return The symbols pat matches.
+*/
+static const char *literalSymbols(Pattern *pat)
+{
+  if (pat->match == matchSymbolPattern)
+    return &((SymbolPattern *)pat)->sym;
+  return ((StringPattern *)pat)->str;
+}
+
+/**
+Make a pattern for a literal of any length.
+
+@param arena The arena to allocate the new pattern from.
+@param str The symbols to match.
+@param len Number of symbols to match.
+@return A symbol or a string pattern for str, or NULL if len is 0.
+*/
+static Pattern *makeLiteral(Arena *arena, const char *str, int len)
+{
+  if (len == 0)
+    return NULL;
+  if (len == 1)
+    return makeSymbolPattern(arena, str[0]);
+  return makeStringPattern(arena, str, len);
+}
+
+/**
+Return the literal at the start of a pattern, which every match of it
+starts with. A concatenation starts with whatever its first subpattern
+does.
+
+@param pat The pattern to look at.
+@return A symbol or a string at the start of pat, or NULL if there isn't
+        one.
+*/
+static Pattern *leadingLiteral(Pattern *pat)
+{
+  while (pat->match == matchConcatenationPattern)
+    pat = ((BinaryPattern *)pat)->p1;
+  return literalLength(pat) ? pat : NULL;
+}
+
+/**
+Return the literal at the end of a pattern, which every match of it
+ends with.
+
+@param pat The pattern to look at.
+@return A symbol or a string at the end of pat, or NULL if there isn't
+        one.
+*/
+static Pattern *trailingLiteral(Pattern *pat)
+{
+  while (pat->match == matchConcatenationPattern)
+    pat = ((BinaryPattern *)pat)->p2;
+  return literalLength(pat) ? pat : NULL;
+}
+
+/**
+Make a pattern for what's left of a pattern once some of the symbols of
+the literal at its start or end are taken off.
+
+@param arena The arena to allocate new patterns from.
+@param pat The pattern to take symbols off.
+@param n How many symbols to take off, at most the length of the literal.
+@param end True to take them off the end, false for the start.
+@return What's left of pat, or NULL if that's nothing at all.
+*/
+static Pattern *dropSymbols(Arena *arena, Pattern *pat, int n, bool end)
+{
+  if (pat->match == matchConcatenationPattern) {
+    BinaryPattern *this = (BinaryPattern *)pat;
+    if (end) {
+      Pattern *p2 = dropSymbols(arena, this->p2, n, end);
+      return p2 ? makeConcatenationPattern(arena, this->p1, p2) : this->p1;
+    }
+    Pattern *p1 = dropSymbols(arena, this->p1, n, end);
+    return p1 ? makeConcatenationPattern(arena, p1, this->p2) : this->p2;
+  }
+
+  const char *str = literalSymbols(pat);
+  int len = literalLength(pat);
+  return makeLiteral(arena, end ? str : str + n, len - n);
+}
+
+/**
+Concatenate a list of patterns, joining each run of symbols and strings
+into one string.
+
+@param arena The arena to allocate new patterns from.
+@param list The patterns to concatenate, none of them concatenations.
+@return The concatenation of the patterns in list.
+*/
+static Pattern *joinConcatenation(Arena *arena, PatternList *list)
+{
+  Pattern *pat = NULL;
+  for (int i = 0; i < list->count; ) {
+    int len = 0;
+    int j = i;
+    while (j < list->count && literalLength(list->items[j]))
+      len += literalLength(list->items[j++]);
+
+    Pattern *p = list->items[i];
+    if (j - i > 1) {
+      char *str = (char *)malloc(len);
+      for (len = 0; i < j; i++) {
+        memcpy(str + len, literalSymbols(list->items[i]),
+          literalLength(list->items[i]));
+        len += literalLength(list->items[i]);
+      }
+      p = makeStringPattern(arena, str, len);
+      free(str);
+    } else {
+      i++;
+    }
+    pat = pat ? makeConcatenationPattern(arena, pat, p) : p;
+  }
+  return pat;
+}
+
+/**
+Concatenate two optimized patterns, joining any literals that meet in
+the middle.
+
+@param arena The arena to allocate new patterns from.
+@param p1 The first pattern.
+@param p2 The second pattern.
+@return The concatenation of p1 and p2.
+*/
+static Pattern *concatenate(Arena *arena, Pattern *p1, Pattern *p2)
+{
+  PatternList list = { NULL, 0, 0 };
+  flatten(p1, false, &list);
+  flatten(p2, false, &list);
+  Pattern *pat = joinConcatenation(arena, &list);
+  free(list.items);
+  return pat;
+}
+
+/**
+Make a repetition of an optimized pattern with *, + or ?. A repetition of
+a repetition, like a** or (a+)?, is the same as a single one: if the two
+are the same kind it's just the inner one, if either is * it's that one,
+and any other mix of + and ? is *.
+
+@param arena The arena to allocate new patterns from.
+@param op The kind of repetition, '*', '+' or '?'.
+@param p The pattern to repeat.
+@return A pattern for the repetition.
+*/
+static Pattern *repeat(Arena *arena, char op, Pattern *p)
+{
+  char inner = p->match == matchStarPattern ? '*' :
+               p->match == matchPlusPattern ? '+' :
+               p->match == matchQMarkPattern ? '?' : 0;
+  if (inner == op || inner == '*')
+    return p;
+  if (inner || op == '*')
+    return makeStarPattern(arena, inner ? ((RepitPattern *)p)->p : p);
+  if (op == '+')
+    return makePlusPattern(arena, p);
+  return makeQMarkPattern(arena, p);
+}
+
+/* Prototype, since alternatives are put together recursively. */
+static Pattern *alternate(Arena *arena, Pattern **alts, int count);
+
+/**
+Add a list of alternatives to another list, with any run of them that
+start with the same literal replaced by that literal followed by the
+alternation of what's left of them, like licen(se|ce) for license|licence.
+Only the last of a run can be left with nothing, which makes the rest
+optional.
+
+@param arena The arena to allocate new patterns from.
+@param alts The optimized alternatives, none of them alternations.
+@param count Number of alternatives.
+@param list The list to add the alternatives to.
+*/
+static void factorPrefixes(Arena *arena, Pattern **alts, int count,
+  PatternList *list)
+{
+  for (int i = 0; i < count; ) {
+    // The run goes on while the prefix they all start with is at least a
+    // symbol long, and every alternative but the last has more than that.
+    Pattern *lead = leadingLiteral(alts[i]);
+    int common = lead ? literalLength(lead) : 0;
+    int j = i;
+    while (j + 1 < count && common > 0) {
+      Pattern *next = leadingLiteral(alts[j + 1]);
+      int n = 0;
+      while (next && n < common && n < literalLength(next) &&
+             literalSymbols(next)[n] == literalSymbols(lead)[n])
+        n++;
+      if (n == 0 || literalLength(alts[j]) == n)
+        break;
+      common = n;
+      j++;
+    }
+
+    if (j == i) {
+      addToList(list, alts[i++]);
+      continue;
+    }
+
+    PatternList rest = { NULL, 0, 0 };
+    for (int k = i; k <= j; k++) {
+      Pattern *p = dropSymbols(arena, alts[k], common, false);
+      if (p)
+        addToList(&rest, p);
+    }
+    Pattern *p = alternate(arena, rest.items, rest.count);
+    if (rest.count <= j - i)
+      p = repeat(arena, '?', p);
+    addToList(list, concatenate(arena,
+      makeLiteral(arena, literalSymbols(lead), common), p));
+    free(rest.items);
+    i = j + 1;
+  }
+}
+
+/**
+Replace each run of alternatives in a list that only match a single
+character, like a|b|[0-9], with one class for all of them.
+
+@param arena The arena to allocate new patterns from.
+@param list The list of alternatives to change.
+*/
+static void mergeClasses(Arena *arena, PatternList *list)
+{
+  int count = 0;
+  for (int i = 0; i < list->count; ) {
+    ByteSet set, one;
+    clearByteSet(&set);
+    int j = i;
+    while (j < list->count && singleCharacter(list->items[j], &one)) {
+      for (int c = 0; c < 256; c++)
+        if (inByteSet(&one, c))
+          addByte(&set, c);
+      j++;
+    }
+
+    if (j - i > 1) {
+      list->items[count++] = makeClassPattern(arena, &set);
+      i = j;
+    } else {
+      list->items[count++] = list->items[i++];
+    }
+  }
+  list->count = count;
+}
+
+/**
+Put a list of alternatives together into an alternation. If they all end
+with the same literal, it's factored out of the end the same way
+factorPrefixes() does for the start, so licen(se|ce) ends up as
+licen([sc])e.
+
+@param arena The arena to allocate new patterns from.
+@param list The alternatives to put together, at least one.
+@return A pattern for the alternation of all of them.
+*/
+static Pattern *joinAlternation(Arena *arena, PatternList *list)
+{
+  Pattern *trail = trailingLiteral(list->items[0]);
+  int common = trail && list->count > 1 ? literalLength(trail) : 0;
+  for (int i = 1; i < list->count && common > 0; i++) {
+    Pattern *next = trailingLiteral(list->items[i]);
+    int n = 0;
+    while (next && n < common && n < literalLength(next) &&
+           literalSymbols(next)[literalLength(next) - 1 - n] ==
+           literalSymbols(trail)[literalLength(trail) - 1 - n])
+      n++;
+    common = n;
+  }
+  // Only the last alternative can be left with nothing.
+  for (int i = 0; i < list->count - 1; i++)
+    if (literalLength(list->items[i]) == common)
+      common = 0;
+
+  if (common > 0) {
+    PatternList rest = { NULL, 0, 0 };
+    for (int i = 0; i < list->count; i++) {
+      Pattern *p = dropSymbols(arena, list->items[i], common, true);
+      if (p)
+        addToList(&rest, p);
+    }
+    Pattern *p = alternate(arena, rest.items, rest.count);
+    if (rest.count < list->count)
+      p = repeat(arena, '?', p);
+    const char *str = literalSymbols(trail) + literalLength(trail) - common;
+    free(rest.items);
+    return concatenate(arena, p, makeLiteral(arena, str, common));
+  }
+
+  Pattern *pat = list->items[0];
+  for (int i = 1; i < list->count; i++)
+    pat = makeAlternationPattern(arena, pat, list->items[i]);
+  return pat;
+}
+
+/**
+Put the alternatives in a list together, factoring out what they have
+in common. The order of the alternatives is kept, and only literals are
+factored out, so the priority of every way of matching them stays the
+same too.
+
+@param arena The arena to allocate new patterns from.
+@param alts The optimized alternatives, none of them alternations.
+@param count Number of alternatives, at least one.
+@return A pattern for the alternation of all of them.
+*/
+static Pattern *alternate(Arena *arena, Pattern **alts, int count)
+{
+  PatternList list = { NULL, 0, 0 };
+  factorPrefixes(arena, alts, count, &list);
+  mergeClasses(arena, &list);
+  Pattern *pat = joinAlternation(arena, &list);
+  free(list.items);
+  return pat;
+}
+
+Pattern *optimizePattern(Arena *arena, Pattern *pat)
+{
+  // Groups only matter to where submatches are, which isn't found with
+  // the optimized pattern.
+  if (pat->match == matchGroupPattern)
+    return optimizePattern(arena, ((GroupPattern *)pat)->p);
+
+  // A chain of concatenations or alternations is optimized as one list of
+  // subpatterns, including any chains that optimizing those turns up.
+  if (pat->match == matchConcatenationPattern ||
+      pat->match == matchAlternationPattern) {
+    bool alternation = pat->match == matchAlternationPattern;
+    PatternList parts = { NULL, 0, 0 };
+    PatternList list = { NULL, 0, 0 };
+    flatten(pat, alternation, &parts);
+    for (int i = 0; i < parts.count; i++)
+      flatten(optimizePattern(arena, parts.items[i]), alternation, &list);
+
+    pat = alternation ? alternate(arena, list.items, list.count) :
+                        joinConcatenation(arena, &list);
+    free(parts.items);
+    free(list.items);
+    return pat;
+  }
+
+  if (pat->match == matchStarPattern || pat->match == matchPlusPattern ||
+      pat->match == matchQMarkPattern) {
+    char op = pat->match == matchStarPattern ? '*' :
+              pat->match == matchPlusPattern ? '+' : '?';
+    return repeat(arena, op, optimizePattern(arena, ((RepitPattern *)pat)->p));
+  }
+
+  if (pat->match == matchCountedPattern) {
+    CountedPattern *this = (CountedPattern *)pat;
+    Pattern *p = optimizePattern(arena, this->p);
+    return p == this->p ? pat :
+      makeCountedPattern(arena, p, this->min, this->max);
+  }
+
+  // Anything else can't be any simpler.
+  return pat;
+}
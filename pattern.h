@@ -16,6 +16,37 @@ match subpattern p itself.
 #define _PATTERN_H_
 
 #include <stdbool.h>
+#include <stdint.h>
+#include "program.h"
+#include "scan.h"
+#include "literal.h"
+
+//////////////////////////////////////////////////////////////////////
+// Packed mark sets
+
+/**
+One word of a packed set of marks. Location i of a string is
+represented by bit (i % MARK_BITS) of word (i / MARK_BITS), so a
+pattern can move a whole word of marks forward with a single shift.
+*/
+typedef uint64_t MarkWord;
+
+/** Number of locations represented by each MarkWord. */
+#define MARK_BITS 64
+
+/** Number of MarkWords needed for the len + 1 locations of a string. */
+#define MARK_WORDS(len) ((len) / MARK_BITS + 1)
+
+/** Mask of the bits in the last MarkWord that are real locations. */
+#define MARK_TAIL(len) (((MarkWord)2 << ((len) % MARK_BITS)) - 1)
+
+/** True if location i is marked in marks. */
+#define GET_MARK(marks, i) \
+  (((marks)[(i) / MARK_BITS] >> ((i) % MARK_BITS)) & 1)
+
+/** Mark location i in marks. */
+#define SET_MARK(marks, i) \
+  ((marks)[(i) / MARK_BITS] |= (MarkWord)1 << ((i) % MARK_BITS))
 
 //////////////////////////////////////////////////////////////////////
 // Superclass for Patterns
@@ -23,25 +54,40 @@ match subpattern p itself.
 /** A short name to use for the Pattern interface. */
 typedef struct PatternTag Pattern;
 
+/**
+A short name to use for the scratch space patterns match with. Patterns
+like concatenation need somewhere to keep marks between subpatterns, and
+take it from a MatchContext instead of the stack, so a long line can't
+overflow the stack and the space is reused from one line to the next.
+*/
+typedef struct MatchContextTag MatchContext;
+
 /**
 Structure used as a superclass/interface for patterns. It includes
-an overrideable method for matching against a given string, and for
-destroying itself to free any allocated resources.
+overrideable methods for matching against a given string, compiling
+itself and finding its literals. Patterns don't free themselves; every
+pattern lives in an Arena, and is freed along with it.
 */
 struct PatternTag {
   /**
   Pointer to a function to match this pattern against the given string by
   computing a new set of marked locations. It fills in locations in the
   after array to indicate places in the string that could be reached
-  after this pattern is matched. The before and after arrays must be one
-  element longer than the length of the string being matched. Patterns are
-  matched against input strings by computing what locations in the input
-  string could be reached after matching a particular pattern or part of a
-  pattern. The locations in a string are treated as being between the
-  characters, including before the first character and after the last
-  character. So, for a string of length n, there will be n + 1 locations.
+  after this pattern is matched. The before and after mark sets must hold
+  MARK_WORDS(len) words, and bits past location len are always zero.
+  Patterns are matched against input strings by computing what locations
+  in the input string could be reached after matching a particular pattern
+  or part of a pattern. The locations in a string are treated as being
+  between the characters, including before the first character and after
+  the last character. So, for a string of length n, there will be n + 1
+  locations.
+  When the pattern ends the whole match, the context says so, and after
+  only has to have some mark in it if there's any to be had, so the
+  pattern can stop at the first location it marks. The string may also be
+  just the start of a longer one, which the context knows the length of.
 
   @param pat The pattern that's supposed to match itself against the string.
+  @param ctx Scratch mark sets for the pattern to keep intermediate marks in.
   @param len Length of the string, we could compute it, but it's more
              efficient to pass it in.
   @param str The input string being matched against.
@@ -50,70 +96,133 @@ struct PatternTag {
   @param after Marks for locations in the string that can be reached after
                matching this pattern.
   */
-  void(*match)(Pattern *pat, int len, const char *str,
-    const bool *before, bool *after);
+  void(*match)(Pattern *pat, MatchContext *ctx, int len, const char *str,
+    const MarkWord *before, MarkWord *after);
+
+  /**
+  Pointer to a function to compile this pattern into instructions at the end
+  of the given program. The instructions match the same strings as the
+  pattern, then fall through to whatever instruction is added next.
+
+  @param pat The pattern to compile.
+  @param prog The program to add instructions to.
+  */
+  void(*compile)(Pattern *pat, Program *prog);
 
   /**
-  Free memory for this pattern, including any subpatterns it contains.
-  @param pat pattern to free.
+  Pointer to a function to work out the literal strings that every match
+  of this pattern must start with, end with or contain.
+
+  @param pat The pattern to analyze.
+  @param lit The literals to fill in for pat.
   */
-  void(*destroy)(Pattern *pat);
+  void(*literals)(Pattern *pat, Literals *lit);
 };
 
+//////////////////////////////////////////////////////////////////////
+// Arena for Patterns
+
+/** A short name to use for the arena patterns are allocated from. */
+typedef struct ArenaTag Arena;
+
+/**
+Make an arena to allocate the patterns for one regular expression from.
+The arena starts out as a single block with room for the given number of
+pattern objects, and only grows if more than that are made from it.
+
+@param nodes Number of pattern objects the arena should have room for.
+@return A dynamically allocated, empty arena.
+*/
+Arena *makeArena(int nodes);
+
+/**
+Free an arena, along with every pattern that was made from it.
+
+@param arena The arena to free.
+*/
+void freeArena(Arena *arena);
+
 /**
 Make a pattern for a single, non-special character, like `a` or `5`.
 
+@param arena The arena to allocate the new pattern from.
 @param sym The symbol this pattern is supposed to match.
-@return A dynamically allocated representation for this new pattern.
+@return A representation for this new pattern, allocated from arena.
 */
-Pattern *makeSymbolPattern(char sym);
+Pattern *makeSymbolPattern(Arena *arena, char sym);
 
 /**
 Make a pattern for one occurrence of any character, as specified by
 the . symbol.
 
+@param arena The arena to allocate the new pattern from.
 @param sym The symbol this pattern is supposed to match.
-@return A dynamically allocated representation for this new pattern.
+@return A representation for this new pattern, allocated from arena.
 */
-Pattern *makeDotPattern(char sym);
+Pattern *makeDotPattern(Arena *arena, char sym);
 
 /**
 Make a pattern for the start anchor, ^.
 
+@param arena The arena to allocate the new pattern from.
 @param sym The symbol this pattern is supposed to match.
-@return A dynamically allocated representation for this new pattern.
+@return A representation for this new pattern, allocated from arena.
 */
-Pattern *makeStartAnchorPattern(char sym);
+Pattern *makeStartAnchorPattern(Arena *arena, char sym);
 
 /**
 Make a pattern for the end anchor, ^.
 
+@param arena The arena to allocate the new pattern from.
 @param sym The symbol this pattern is supposed to match.
-@return A dynamically allocated representation for this new pattern.
+@return A representation for this new pattern, allocated from arena.
+*/
+Pattern *makeEndAnchorPattern(Arena *arena, char sym);
+
+/**
+Make a pattern for a character class, like [a-z] or [^0-9], matching
+one occurrence of any character in a set.
+
+@param arena The arena to allocate the new pattern from.
+@param set The characters this pattern is supposed to match.
+@return A representation for this new pattern, allocated from arena.
 */
-Pattern *makeEndAnchorPattern(char sym);
+Pattern *makeClassPattern(Arena *arena, const ByteSet *set);
+
+/**
+Make a pattern for a run of two or more ordinary symbols, matching the
+same strings as a concatenation of a symbol pattern for each of them.
+
+@param arena The arena to allocate the new pattern from.
+@param str The symbols this pattern is supposed to match, copied into it.
+@param len Number of symbols in str.
+@return A representation for this new pattern, allocated from arena.
+*/
+Pattern *makeStringPattern(Arena *arena, const char *str, int len);
 
 /**
 Make a pattern for the concatenation of patterns p1 and p2. It should match
 anything that can be broken into two substrings, s1 and s2, where the p1
 matches the first part (s1) and p2 matches the second part (s2).
 
+@param arena The arena to allocate the new pattern from.
 @param p1 Subpattern for matching the first part of the string.
 @param p2 Subpattern for matching the second part of the string.
-@return A dynamically allocated representation for this new pattern.
+@return A representation for this new pattern, allocated from arena.
 */
-Pattern *makeConcatenationPattern(Pattern *p1, Pattern *p2);
+Pattern *makeConcatenationPattern(Arena *arena, Pattern *p1, Pattern *p2);
 
 /**
 Make a pattern for the alternation of patterns p1 and p2. It matches
 anything that can be matched by either p1 or p2. So "cat|dog" will
 match "cat" or "dog".
 
+@param arena The arena to allocate the new pattern from.
 @param p1 Subpattern for matching the first part of the string.
 @param p2 Subpattern for matching the second part of the string.
-@return A dynamically allocated representation for this new pattern.
+@return A representation for this new pattern, allocated from arena.
 */
-Pattern *makeAlternationPattern(Pattern *p1, Pattern *p2);
+Pattern *makeAlternationPattern(Arena *arena, Pattern *p1, Pattern *p2);
 
 
 /**
@@ -121,47 +230,201 @@ Make a pattern for matching zero or more consecutive occurrences of
 anything that p matches. For example, b* would match the middle of the
 strings "abc", "abbbc" or even "ac" (zero occurrences of b).
 
+@param arena The arena to allocate the new pattern from.
 @param p A pattern followed by *.
-@return A dynamically allocated representation of this new pattern.
+@return A representation of this new pattern, allocated from arena.
 */
-Pattern *makeStarPattern(Pattern *p);
+Pattern *makeStarPattern(Arena *arena, Pattern *p);
 
 /**
 Make a pattern for matching one or more consecutive occurrences of
 anything that p matches.
 
+@param arena The arena to allocate the new pattern from.
 @param p A pattern followed by +.
-@return A dynamically allocated representation of this new pattern.
+@return A representation of this new pattern, allocated from arena.
 */
-Pattern *makePlusPattern(Pattern *p);
+Pattern *makePlusPattern(Arena *arena, Pattern *p);
 
 /**
 Make a pattern for matching zero or one consecutive occurrences of
 anything that p matches. For example, a pattern followed b a
 question mark is like an optional match in a pattern.
 
+@param arena The arena to allocate the new pattern from.
 @param p A pattern followed by ?.
-@return A dynamically allocated representation of this new pattern.
+@return A representation of this new pattern, allocated from arena.
+*/
+Pattern *makeQMarkPattern(Arena *arena, Pattern *p);
+
+/**
+Make a pattern for matching a counted number of consecutive occurrences
+of anything that p matches, like a{3}, a{2,} or a{2,5}.
+
+@param arena The arena to allocate the new pattern from.
+@param p A pattern followed by a repetition count.
+@param min Fewest occurrences to match.
+@param max Most occurrences to match, or -1 for no limit.
+@return A representation of this new pattern, allocated from arena.
+*/
+Pattern *makeCountedPattern(Arena *arena, Pattern *p, int min, int max);
+
+/**
+Make a pattern for a parenthesized group, which matches whatever the
+pattern inside it does. Programs compiled for finding submatches also
+record where it matched. Groups are numbered by numberGroups().
+
+@param arena The arena to allocate the pattern from.
+@param p The pattern inside the parentheses.
+@return A representation of this new pattern, allocated from arena.
+*/
+Pattern *makeGroupPattern(Arena *arena, Pattern *p);
+
+/**
+Compile a whole pattern into a program that can be run by a Machine,
+ending with an OP_MATCH instruction.
+
+@param pat The pattern to compile.
+@return A dynamically allocated program for pat.
+*/
+Program *compilePattern(Pattern *pat);
+
+/**
+Compile several patterns into one program that matches wherever any of
+them does. Each pattern ends in its own OP_MATCH instruction, with its
+index in pats as the instruction's x, so a Machine can tell which ones
+matched.
+
+@param pats The patterns to compile. Entries can be NULL, for indices
+            that have no pattern, but at least one can't be.
+@param count Number of entries in pats.
+@return A dynamically allocated program for the patterns.
+*/
+Program *compilePatternSet(Pattern **pats, int count);
+
+/**
+Compile several patterns into a program like compilePatternSet(), but with
+each pattern back to front, so it matches the reverse of every string the
+patterns match. Run over a string from its end to its start, it finds the
+locations where matches start.
+
+@param pats The patterns to compile. Entries can be NULL, but at least one
+            can't be.
+@param count Number of entries in pats.
+@return A dynamically allocated program for the reversed patterns.
+*/
+Program *compileReversePatternSet(Pattern **pats, int count);
+
+/**
+Compile several patterns into a program like compilePatternSet(), but
+with an OP_SAVE instruction at the start and end of each group, recording
+the location in slots 2k and 2k + 1 for group k. This is only for finding
+submatches; the other engines don't know about OP_SAVE.
+
+@param pats The patterns to compile, with their groups numbered. Entries
+            can be NULL, but at least one can't be.
+@param count Number of entries in pats.
+@param groups The most groups any of the patterns has.
+@return A dynamically allocated program for the patterns.
+*/
+Program *compileCapturePatternSet(Pattern **pats, int count, int groups);
+
+/**
+Work out the literal strings that every match of any of several patterns
+must start with, end with or contain.
+
+@param pats The patterns to analyze. Entries can be NULL, but at least one
+            can't be.
+@param count Number of entries in pats.
+@param lit The literals to fill in.
 */
-Pattern *makeQMarkPattern(Pattern *p);
+void patternSetLiterals(Pattern **pats, int count, Literals *lit);
+
+/**
+Return the most instructions compiling a pattern can add to a program, so
+the parser can refuse repetitions that would make one too big.
+
+@param pat The pattern to look at.
+@return The most instructions pat compiles into.
+*/
+int compiledSize(Pattern *pat);
+
+/**
+Number the groups in a pattern from 1, in the order of their opening
+parentheses, like the groups of most regular expression libraries.
+
+@param pat The pattern to number the groups in.
+@return The number of groups in pat.
+*/
+int numberGroups(Pattern *pat);
+
+/**
+Make a simpler pattern that matches the same strings as another, with
+fewer, bigger objects. Runs of symbols become strings, and alternatives
+that start or end with the same literal have it factored out, like
+licen[cs]e for license|licence. Alternatives that match a single
+character become a class, and repetitions of repetitions, like a** or
+(a*)*, become one. Groups are left out, so it's no good for finding
+submatches.
+
+@param arena The arena to allocate new patterns from.
+@param pat The pattern to optimize, which is left as it was.
+@return The optimized pattern, sharing parts of pat where it can.
+*/
+Pattern *optimizePattern(Arena *arena, Pattern *pat);
+
+/**
+Make a context with scratch space for matching patterns. It grows as
+needed to fit the longest string matched with it.
+
+@return A dynamically allocated match context.
+*/
+MatchContext *makeMatchContext();
+
+/**
+Report whether a pattern matches anywhere in the given string, using the
+scratch space in ctx for every mark set needed along the way.
+
+@param pat The pattern to match.
+@param ctx The context to match with.
+@param len Length of the string.
+@param str The input string being matched against.
+@return True if pat matches some part of str.
+*/
+bool matchPattern(Pattern *pat, MatchContext *ctx, int len, const char *str);
+
+/**
+Free a match context and all of its scratch space.
+
+@param ctx The context to free.
+*/
+void freeMatchContext(MatchContext *ctx);
+
+/**
+Mark every location of a string, so a pattern can start matching
+anywhere in it.
+
+@param len Length of the string.
+@param marks Mark set of MARK_WORDS(len) words to fill in.
+*/
+void setAllMarks(int len, MarkWord *marks);
 
 /**
 Helpful function to print out a string, with the marks shown between
 the characters as asterisks.
 
+@param len Length of the string.
 @param str String to report.
-@param marks Array of marks between the characters of str, assumed
-             to be one element longer than the length of str.
+@param marks Marks between the characters of str.
 */
-void reportMarks(const char *str, const bool *marks);
+void reportMarks(int len, const char *str, const MarkWord *marks);
 
 /**
 Returns whether or not the string was a pattern match.
 
-@param str String to report.
-@param marks Array of marks between the characters of str, assumed
-to be one element longer than the length of str.
+@param len Length of the string.
+@param marks Marks between the characters of the string.
 */
-bool isMatch(const char *str, const bool *marks);
+bool isMatch(int len, const MarkWord *marks);
 
 #endif
@@ -0,0 +1,390 @@
+/**
+@file program.c
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The program.c component implements the instruction arrays that Pattern
+trees are compiled into, and the machine that runs them. The machine is a
+Pike VM: it steps every live thread forward one character at a time, so each
+instruction is visited at most once per location in the input string.
+*/
+
+/* Headers */
+#include "program.h"
+#include <stdlib.h>
+
+/* Constant Definitions */
+#define INITIAL_CAPACITY 16  /* Starting number of instructions in a program */
+
+
+/********************************************************************
+*
+*                          PROGRAM FUNCTIONS
+*
+********************************************************************/
+Program *makeProgram()
+{
+  Program *prog = (Program *)malloc(sizeof(Program));
+  prog->cap = INITIAL_CAPACITY;
+  prog->len = 0;
+  prog->inst = (Instruction *)malloc(prog->cap * sizeof(Instruction));
+  prog->sets = NULL;
+  prog->nsets = 0;
+  prog->reverse = false;
+  prog->captures = false;
+  prog->nslots = 2;
+  return prog;
+}
+
+int emitInstruction(Program *prog, Opcode op)
+{
+  // Grow the instruction array if it's full.
+  if (prog->len >= prog->cap) {
+    prog->cap *= 2;
+    prog->inst = (Instruction *)realloc(prog->inst,
+      prog->cap * sizeof(Instruction));
+  }
+
+  Instruction *inst = &prog->inst[prog->len];
+  inst->op = op;
+  inst->sym = '\0';
+  inst->x = inst->y = 0;
+
+  return prog->len++;
+}
+
+int addByteSetToProgram(Program *prog, const ByteSet *set)
+{
+  // Classes are rare enough that growing one at a time is fine.
+  prog->sets = (ByteSet *)realloc(prog->sets,
+    (prog->nsets + 1) * sizeof(ByteSet));
+  prog->sets[prog->nsets] = *set;
+  return prog->nsets++;
+}
+
+void freeProgram(Program *prog)
+{
+  free(prog->sets);
+  free(prog->inst);
+  free(prog);
+}
+
+
+/********************************************************************
+*
+*                          MACHINE DEFINITION
+*
+********************************************************************/
+/**
+A set of threads, one per instruction index, stored as a sparse set so
+it can be cleared in constant time and tested for membership without
+ever being zeroed out.
+*/
+typedef struct {
+  int *dense;         /* Instruction indices in the set, in insertion order */
+  int *sparse;        /* Position of each instruction index in dense */
+  long *origin;       /* Where the match each thread is part of started, by
+                         position in dense, for runMachineSpan() */
+  int n;              /* Number of threads in the set */
+} ThreadList;
+
+struct MachineTag {
+  const Program *prog;  /* Program this machine runs */
+  ThreadList clist;     /* Threads at the current location */
+  ThreadList nlist;     /* Threads at the next location */
+  int *stack;           /* Work stack for following branches */
+  int patterns;         /* Number of OP_MATCH instructions, one for each
+                           pattern in a set */
+  bool anchored;        /* True if a match can only start at the start
+                           of the line */
+};
+
+/**
+Return true if the given instruction is already in the thread list.
+*/
+static bool onList(const ThreadList *list, int pc)
+{
+  int i = list->sparse[pc];
+  return i < list->n && list->dense[i] == pc;
+}
+
+/**
+Add a thread for instruction pc to the list, along with every instruction
+that can be reached from it without matching a character. Only the
+instructions that consume a character (or report a match) are left for
+the caller to step, but branches are recorded too, so they're only
+followed once per location.
+
+@param m The machine the list belongs to.
+@param list The list to add threads to.
+@param pc Index of the instruction to start from.
+@param pos Location in the string the threads are at.
+@param len Length of the string.
+*/
+static void addThread(Machine *m, ThreadList *list, int pc, long pos,
+  long len)
+{
+  const Instruction *inst = m->prog->inst;
+  int top = 0;
+
+  m->stack[top++] = pc;
+  while (top > 0) {
+    pc = m->stack[--top];
+    if (onList(list, pc))
+      continue;
+    list->sparse[pc] = list->n;
+    list->dense[list->n++] = pc;
+
+    switch (inst[pc].op) {
+    case OP_JMP:
+      m->stack[top++] = inst[pc].x;
+      break;
+    case OP_SPLIT:
+      m->stack[top++] = inst[pc].y;
+      m->stack[top++] = inst[pc].x;
+      break;
+    case OP_BOL:
+      if (pos == 0)
+        m->stack[top++] = pc + 1;
+      break;
+    case OP_EOL:
+      if (pos == len)
+        m->stack[top++] = pc + 1;
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+Machine *makeMachine(const Program *prog)
+{
+  Machine *m = (Machine *)malloc(sizeof(Machine));
+  m->prog = prog;
+
+  // Every instruction can be on each list at most once, and each one
+  // added to a list pushes at most two more onto the stack.
+  m->clist.dense = (int *)malloc(prog->len * sizeof(int));
+  m->clist.sparse = (int *)calloc(prog->len, sizeof(int));
+  m->nlist.dense = (int *)malloc(prog->len * sizeof(int));
+  m->nlist.sparse = (int *)calloc(prog->len, sizeof(int));
+  m->clist.origin = (long *)malloc(prog->len * sizeof(long));
+  m->nlist.origin = (long *)malloc(prog->len * sizeof(long));
+  m->stack = (int *)malloc((2 * prog->len + 1) * sizeof(int));
+
+  // Once every pattern in a set has matched, there's nothing left to find.
+  m->patterns = 0;
+  for (int pc = 0; pc < prog->len; pc++)
+    if (prog->inst[pc].op == OP_MATCH)
+      m->patterns++;
+
+  // See whether a thread started anywhere but the start of the line, in
+  // the middle or at the end, could ever get anywhere.
+  m->anchored = true;
+  for (int len = 1; len <= 2; len++) {
+    m->clist.n = 0;
+    addThread(m, &m->clist, 0, 1, len);
+    for (int i = 0; i < m->clist.n; i++) {
+      Opcode op = prog->inst[m->clist.dense[i]].op;
+      if (op == OP_CHAR || op == OP_ANY || op == OP_CLASS || op == OP_MATCH)
+        m->anchored = false;
+    }
+  }
+
+  return m;
+}
+
+bool runMachine(Machine *m, long len, const char *str)
+{
+  const Instruction *inst = m->prog->inst;
+  ThreadList *clist = &m->clist;
+  ThreadList *nlist = &m->nlist;
+
+  clist->n = 0;
+  for (long pos = 0; ; pos++) {
+    // A match could start at any location, so start a new thread here too,
+    // unless it can only start at the start of the line. Then, once every
+    // thread has failed, the line can't match.
+    if (pos == 0 || !m->anchored)
+      addThread(m, clist, 0, pos, len);
+    else if (clist->n == 0)
+      return false;
+
+    // Step every thread over the character at pos.
+    nlist->n = 0;
+    for (int i = 0; i < clist->n; i++) {
+      int pc = clist->dense[i];
+      switch (inst[pc].op) {
+      case OP_MATCH:
+        return true;
+      case OP_CHAR:
+        if (pos < len && str[pos] == inst[pc].sym)
+          addThread(m, nlist, pc + 1, pos + 1, len);
+        break;
+      case OP_ANY:
+        if (pos < len)
+          addThread(m, nlist, pc + 1, pos + 1, len);
+        break;
+      case OP_CLASS:
+        if (pos < len && inByteSet(&m->prog->sets[inst[pc].x], str[pos]))
+          addThread(m, nlist, pc + 1, pos + 1, len);
+        break;
+      default:
+        break;
+      }
+    }
+
+    if (pos == len)
+      return false;
+
+    // The next location's threads become the current ones.
+    ThreadList *tmp = clist;
+    clist = nlist;
+    nlist = tmp;
+  }
+}
+
+int runMachineSet(Machine *m, long len, const char *str, bool *hits)
+{
+  const Instruction *inst = m->prog->inst;
+  ThreadList *clist = &m->clist;
+  ThreadList *nlist = &m->nlist;
+  int count = 0;
+
+  clist->n = 0;
+  for (long pos = 0; ; pos++) {
+    if (pos == 0 || !m->anchored)
+      addThread(m, clist, 0, pos, len);
+    else if (clist->n == 0)
+      return count;
+
+    // Step every thread just like runMachine(), but only note each match,
+    // and stop early once every pattern has one.
+    nlist->n = 0;
+    for (int i = 0; i < clist->n; i++) {
+      int pc = clist->dense[i];
+      switch (inst[pc].op) {
+      case OP_MATCH:
+        if (!hits[inst[pc].x]) {
+          hits[inst[pc].x] = true;
+          if (++count == m->patterns)
+            return count;
+        }
+        break;
+      case OP_CHAR:
+        if (pos < len && str[pos] == inst[pc].sym)
+          addThread(m, nlist, pc + 1, pos + 1, len);
+        break;
+      case OP_ANY:
+        if (pos < len)
+          addThread(m, nlist, pc + 1, pos + 1, len);
+        break;
+      case OP_CLASS:
+        if (pos < len && inByteSet(&m->prog->sets[inst[pc].x], str[pos]))
+          addThread(m, nlist, pc + 1, pos + 1, len);
+        break;
+      default:
+        break;
+      }
+    }
+
+    if (pos == len)
+      return count;
+
+    ThreadList *tmp = clist;
+    clist = nlist;
+    nlist = tmp;
+  }
+}
+
+/**
+Add a thread for instruction pc to the list, just like addThread(), and
+record where the match it's part of started for every thread added.
+
+@param m The machine the list belongs to.
+@param list The list to add threads to.
+@param pc Index of the instruction to start from.
+@param pos Location in the string the threads are at.
+@param len Length of the string.
+@param origin Location where the match started.
+*/
+static void addSpanThread(Machine *m, ThreadList *list, int pc, long pos,
+  long len, long origin)
+{
+  int n = list->n;
+  addThread(m, list, pc, pos, len);
+  for (int i = n; i < list->n; i++)
+    list->origin[i] = origin;
+}
+
+bool runMachineSpan(Machine *m, long len, const char *str, long from,
+  long *start, long *end)
+{
+  const Instruction *inst = m->prog->inst;
+  ThreadList *clist = &m->clist;
+  ThreadList *nlist = &m->nlist;
+  bool found = false;
+
+  clist->n = 0;
+  for (long pos = from; ; pos++) {
+    // New threads go at the end of the list, so it stays in order of where
+    // each thread started. Once there's a match, any match starting later
+    // can't beat it.
+    if (!found && (pos == 0 || !m->anchored))
+      addSpanThread(m, clist, 0, pos, len, pos);
+    else if (clist->n == 0)
+      return found;
+
+    nlist->n = 0;
+    for (int i = 0; i < clist->n; i++) {
+      int pc = clist->dense[i];
+      long origin = clist->origin[i];
+      if (found && origin > *start)
+        break;
+
+      switch (inst[pc].op) {
+      case OP_MATCH:
+        // Matches are found in order of where they end, so a later one
+        // from the same start is longer.
+        if (!found || origin < *start || pos > *end) {
+          *start = origin;
+          *end = pos;
+          found = true;
+        }
+        break;
+      case OP_CHAR:
+        if (pos < len && str[pos] == inst[pc].sym)
+          addSpanThread(m, nlist, pc + 1, pos + 1, len, origin);
+        break;
+      case OP_ANY:
+        if (pos < len)
+          addSpanThread(m, nlist, pc + 1, pos + 1, len, origin);
+        break;
+      case OP_CLASS:
+        if (pos < len && inByteSet(&m->prog->sets[inst[pc].x], str[pos]))
+          addSpanThread(m, nlist, pc + 1, pos + 1, len, origin);
+        break;
+      default:
+        break;
+      }
+    }
+
+    if (pos == len)
+      return found;
+
+    ThreadList *tmp = clist;
+    clist = nlist;
+    nlist = tmp;
+  }
+}
+
+void freeMachine(Machine *m)
+{
+  free(m->clist.dense);
+  free(m->clist.sparse);
+  free(m->nlist.dense);
+  free(m->nlist.sparse);
+  free(m->clist.origin);
+  free(m->nlist.origin);
+  free(m->stack);
+  free(m);
+}
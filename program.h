@@ -0,0 +1,158 @@
+/**
+@file program.h
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The program.h file contains the flat instruction representation a Pattern
+tree is compiled into, along with a Pike-VM-style machine that runs a
+compiled program over an input string.
+<p>
+Instead of passing arrays of marks from one pattern object to the next, the
+machine keeps the set of instructions that could be reached after each
+character of the input (its threads), so it only needs a single pass over
+the string to decide whether it contains a match.
+*/
+#ifndef _PROGRAM_H_
+#define _PROGRAM_H_
+
+#include <stdbool.h>
+#include "scan.h"
+
+/** Operations an instruction in a program can perform. */
+typedef enum {
+  OP_CHAR,   /* Match one occurrence of sym, then go on to the next */
+  OP_ANY,    /* Match one occurrence of any character */
+  OP_CLASS,  /* Match one occurrence of any character in set x */
+  OP_SPLIT,  /* Continue at both x and y */
+  OP_JMP,    /* Continue at x */
+  OP_BOL,    /* Continue only at the start of the line */
+  OP_EOL,    /* Continue only at the end of the line */
+  OP_SAVE,   /* Record the location in slot x, then go on to the next;
+                only in programs for finding submatches */
+  OP_MATCH   /* The whole pattern has been matched, pattern x if the
+                program was compiled from several */
+} Opcode;
+
+/** One instruction in a compiled program. */
+typedef struct {
+  Opcode op;        /* What this instruction does */
+  char sym;         /* Symbol matched by OP_CHAR */
+  int x, y;         /* Branch targets for OP_SPLIT and OP_JMP, or the
+                       index of the set for OP_CLASS in x */
+} Instruction;
+
+/** A short name to use for a compiled program. */
+typedef struct ProgramTag Program;
+
+/** A compiled pattern, a growable array of instructions. */
+struct ProgramTag {
+  Instruction *inst;  /* Instructions, executed starting from index 0 */
+  int len;            /* Number of instructions in the program */
+  int cap;            /* Capacity of the inst array */
+  ByteSet *sets;      /* Character sets used by OP_CLASS instructions */
+  int nsets;          /* Number of character sets */
+  bool reverse;       /* True if patterns are compiled back to front, for
+                         running over a string from its end to its start */
+  bool captures;      /* True if groups are compiled with OP_SAVE */
+  int nslots;         /* Number of slots OP_SAVE can record in */
+};
+
+/** A short name to use for the machine that runs a program. */
+typedef struct MachineTag Machine;
+
+/**
+Make a new, empty program.
+
+@return A dynamically allocated program with no instructions.
+*/
+Program *makeProgram();
+
+/**
+Add an instruction to the end of the program. Branch targets are left
+as zero, for the caller to fill in once they're known.
+
+@param prog The program to add the instruction to.
+@param op The operation for the new instruction.
+@return The index of the new instruction.
+*/
+int emitInstruction(Program *prog, Opcode op);
+
+/**
+Add a copy of a character set to the program, for OP_CLASS instructions
+to refer to.
+
+@param prog The program to add the set to.
+@param set The set to add.
+@return The index of the new set.
+*/
+int addByteSetToProgram(Program *prog, const ByteSet *set);
+
+/**
+Free the memory for a program and its instructions.
+
+@param prog The program to free.
+*/
+void freeProgram(Program *prog);
+
+/**
+Make a machine for running the given program. The machine holds all the
+storage it needs to run the program, so it can be reused for any number of
+strings without allocating more memory.
+
+@param prog The program this machine will run. It must outlive the machine.
+@return A dynamically allocated machine for prog.
+*/
+Machine *makeMachine(const Program *prog);
+
+/**
+Return true if the machine's program matches anywhere in the given string.
+
+@param m The machine to run.
+@param len Length of the string.
+@param str The input string being matched against.
+@return True if the string contains a match.
+*/
+bool runMachine(Machine *m, long len, const char *str);
+
+/**
+Find every pattern that matches somewhere in the given string, for a
+program compiled from several patterns. Unlike runMachine(), this keeps
+going after the first match, until the end of the string or until every
+pattern has matched.
+
+@param m The machine to run.
+@param len Length of the string.
+@param str The input string being matched against.
+@param hits Set to true for each pattern that matches, by the x of its
+            OP_MATCH instruction. The caller clears it beforehand.
+@return Number of patterns newly set in hits.
+*/
+int runMachineSet(Machine *m, long len, const char *str, bool *hits);
+
+/**
+Find the leftmost-longest match in the given string that starts at or
+after a given location: of the matches that start there, the one that
+starts first, and of those, the one that ends last. Each thread keeps
+track of where its match started, and the threads are kept in order of
+that, so when two of them reach the same instruction, the one that
+started first is the one that's kept.
+
+@param m The machine to run.
+@param len Length of the string.
+@param str The input string being matched against.
+@param from Location to look for a match from. Anchors still only match at
+            the ends of the whole string.
+@param start Set to the location where the match starts.
+@param end Set to the location just past the end of the match.
+@return True if there's a match at or after from.
+*/
+bool runMachineSpan(Machine *m, long len, const char *str, long from,
+  long *start, long *end);
+
+/**
+Free the memory for a machine.
+
+@param m The machine to free.
+*/
+void freeMachine(Machine *m);
+
+#endif
@@ -0,0 +1,576 @@
+/**
+@file regexer.c
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The regexer.c component puts the parser and the matching engines together
+behind the library interface. Compiling a pattern parses it, simplifies
+it, compiles it into a program, and works out everything about it that
+never changes: the literal string every match contains, the Aho-Corasick
+automaton for patterns that only match a known set of strings, and the
+Shift-And matcher for small ones. Searching uses the fastest of these
+that applies, falling back to the DFA, and then to the Shift-And matcher
+or the machine for lines the DFA gives up on. With RX_MARKS, lines are
+decided by matching the optimized pattern objects themselves with the
+mark engine instead.
+<p>
+Finding where the matches in a line are takes two more DFAs, which are
+only built the first time they're needed: one for the patterns compiled
+in reverse, which finds where every match starts in one backward pass,
+and an anchored one, which finds where the longest match from each start
+ends. Where the groups in it matched is left to a capturer, for a program
+that records them, which is only made when submatches are asked for.
+*/
+
+/* Headers */
+#define _GNU_SOURCE
+#include "regexer.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parse.h"
+#include "dfa.h"
+#include "bitap.h"
+#include "aho.h"
+#include "capture.h"
+
+/* Constant Definitions */
+#define DFA_BUDGET (8 * 1024 * 1024)  /* Bytes of cached DFA states */
+
+
+/********************************************************************
+*
+*                          REGEX DEFINITION
+*
+********************************************************************/
+/**
+The parts of a handle that are changed while matching, which only one
+thread can use at a time.
+*/
+typedef struct WorkerTag {
+  DFA *dfa;                 /* Lazily built DFA, or NULL without one */
+  Machine *m;               /* Machine for lines nothing else decides */
+  DFA *rdfa;                /* DFA for finding where matches start, or
+                               NULL if it hasn't been needed yet */
+  DFA *adfa;                /* Anchored DFA for finding where they end,
+                               or NULL if it hasn't been needed yet */
+  bool *starts;             /* Where matches start in the current line */
+  long cap;                 /* Capacity of starts */
+  Capturer *capturer;       /* Finds where groups matched, or NULL if it
+                               hasn't been needed yet */
+  long *slots;              /* Slots for the capturer to record in */
+  MatchContext *ctx;        /* Scratch for the mark engine, or NULL
+                               without RX_MARKS */
+  struct WorkerTag *next;   /* Next idle worker in the pool */
+} Worker;
+
+/**
+Workers not in use by any thread, kept for the next call that needs one.
+*/
+typedef struct {
+  Worker *idle;             /* List of idle workers */
+  pthread_mutex_t lock;     /* Protects idle */
+} WorkerPool;
+
+struct RegexTag {
+  Arena *arena;             /* Arena the pattern objects live in */
+  Program *prog;            /* Patterns compiled into instructions */
+  Program *rprog;           /* Patterns compiled in reverse */
+  Program *cprog;           /* Patterns compiled to record where groups
+                               match, or NULL if they have no groups */
+  int ngroups;              /* Most groups any of the patterns has */
+  int npats;                /* Number of patterns the set was made from */
+  Pattern **pats;           /* Optimized patterns, NULL for ones that
+                               never match, for the mark engine */
+  int flags;                /* RX_ flags the handle was compiled with */
+  Literals lit;             /* Literal strings in every match */
+  const char *must;         /* String every match contains, or NULL */
+  int mustLen;              /* Length of must */
+  AhoCorasick *ac;          /* Used instead of the DFA if the patterns only
+                               match a known set of strings, or NULL */
+  Bitap *bitap;             /* Used instead of the machine for small
+                               patterns, or NULL */
+  WorkerPool *pool;         /* Workers for threads to borrow */
+};
+
+/**
+Borrow a worker from a handle's pool, making a new one if they're all in
+use.
+
+@param rx The handle to borrow from.
+@return A worker only the calling thread can use until it's given back.
+*/
+static Worker *takeWorker(const Regex *rx)
+{
+  pthread_mutex_lock(&rx->pool->lock);
+  Worker *w = rx->pool->idle;
+  if (w)
+    rx->pool->idle = w->next;
+  pthread_mutex_unlock(&rx->pool->lock);
+
+  if (!w) {
+    w = (Worker *)malloc(sizeof(Worker));
+    w->dfa = rx->flags & (RX_NO_DFA | RX_MARKS) ? NULL :
+      makeDFA(rx->prog, DFA_BUDGET);
+    w->m = makeMachine(rx->prog);
+    w->rdfa = NULL;
+    w->adfa = NULL;
+    w->starts = NULL;
+    w->cap = 0;
+    w->capturer = NULL;
+    w->slots = NULL;
+    w->ctx = rx->flags & RX_MARKS ? makeMatchContext() : NULL;
+  }
+  return w;
+}
+
+/**
+Give a borrowed worker back to a handle's pool, keeping any DFA states it
+built for the next thread to use it.
+
+@param rx The handle the worker was borrowed from.
+@param w The worker to give back.
+*/
+static void giveWorker(const Regex *rx, Worker *w)
+{
+  pthread_mutex_lock(&rx->pool->lock);
+  w->next = rx->pool->idle;
+  rx->pool->idle = w;
+  pthread_mutex_unlock(&rx->pool->lock);
+}
+
+Regex *rx_compile(const char *pattern, int flags)
+{
+  return rx_compile_set(1, &pattern, flags);
+}
+
+Regex *rx_compile_set(int count, const char *const *patterns, int flags)
+{
+  // Make room in one arena for every pattern, plus a spare object.
+  int nodes = 1;
+  for (int i = 0; i < count; i++)
+    if (patterns[i])
+      nodes += parseSize(patterns[i]);
+  Arena *arena = makeArena(nodes);
+
+  Pattern **pats = (Pattern **)malloc((count > 0 ? count : 1) *
+    sizeof(Pattern *));
+  bool any = false;
+  int ngroups = 0;
+  for (int i = 0; i < count; i++) {
+    pats[i] = NULL;
+    if (patterns[i] && patterns[i][0]) {
+      if (!(pats[i] = parsePattern(arena, patterns[i]))) {
+        free(pats);
+        freeArena(arena);
+        return NULL;
+      }
+      any = true;
+
+      int n = numberGroups(pats[i]);
+      if (n > ngroups)
+        ngroups = n;
+    }
+  }
+
+  // With no patterns at all, nothing can match, just like an empty class.
+  Pattern *none = NULL;
+  if (!any) {
+    ByteSet empty;
+    clearByteSet(&empty);
+    none = makeClassPattern(arena, &empty);
+  }
+
+  Regex *rx = (Regex *)malloc(sizeof(Regex));
+  rx->arena = arena;
+  rx->npats = count;
+  rx->pats = pats;
+  rx->flags = flags;
+
+  // Groups only matter for finding submatches, so their program is
+  // compiled from the patterns as they were parsed, and everything else
+  // from optimized ones that match the same strings with fewer objects.
+  rx->ngroups = ngroups;
+  rx->cprog = ngroups ? compileCapturePatternSet(pats, count, ngroups) : NULL;
+  for (int i = 0; i < count; i++)
+    if (pats[i])
+      pats[i] = optimizePattern(arena, pats[i]);
+
+  // Patterns in a set are compiled together, so the DFA finds lines any of
+  // them match in one pass, and the machine only has to sort out which
+  // ones matched those lines.
+  rx->prog = any ? compilePatternSet(pats, count) : compilePatternSet(&none, 1);
+  rx->rprog = any ? compileReversePatternSet(pats, count) :
+                    compileReversePatternSet(&none, 1);
+  rx->bitap = flags & (RX_NO_BITAP | RX_MARKS) ? NULL : makeBitap(rx->prog);
+
+  // Find a string every match has to contain, so input without it can be
+  // skipped quickly. Matches never span lines, so one with a newline in it
+  // is no help.
+  if (any)
+    patternSetLiterals(pats, count, &rx->lit);
+  else
+    none->literals(none, &rx->lit);
+  rx->must = NULL;
+  rx->mustLen = 0;
+  if (!(flags & RX_NO_LITERALS) && rx->lit.in[0] &&
+      !strchr(rx->lit.in, '\n')) {
+    rx->must = rx->lit.in;
+    rx->mustLen = strlen(rx->lit.in);
+  }
+
+  // If the pattern can only match a known set of strings, like a list of
+  // words, look for all of them at once instead. An empty one would match
+  // every line, and one with a newline in it could never match a line, so
+  // those are left to the DFA.
+  rx->ac = NULL;
+  if (!(flags & RX_NO_LITERALS) && rx->lit.exact.count > 0 &&
+      !rx->lit.anchored) {
+    bool plain = true;
+    for (int i = 0; i < rx->lit.exact.count; i++)
+      if (!rx->lit.exact.strs[i][0] || strchr(rx->lit.exact.strs[i], '\n'))
+        plain = false;
+    if (plain)
+      rx->ac = makeAhoCorasick(rx->lit.exact.count, rx->lit.exact.strs,
+        DFA_BUDGET);
+  }
+
+  rx->pool = (WorkerPool *)malloc(sizeof(WorkerPool));
+  rx->pool->idle = NULL;
+  pthread_mutex_init(&rx->pool->lock, NULL);
+  return rx;
+}
+
+
+/********************************************************************
+*
+*                          SEARCH FUNCTIONS
+*
+********************************************************************/
+/**
+Match a line against each pattern in a set with the mark engine.
+
+@param rx The compiled regular expression.
+@param w A worker borrowed from rx's pool, with a match context.
+@param len Length of the line.
+@param str The line to match against.
+@param hits Set to true for each pattern that matches, or NULL to stop at
+            the first one.
+@return The number of patterns found to match.
+*/
+static int matchMarks(const Regex *rx, Worker *w, int len, const char *str,
+  bool *hits)
+{
+  int count = 0;
+  for (int i = 0; i < rx->npats; i++)
+    if (rx->pats[i] && matchPattern(rx->pats[i], w->ctx, len, str)) {
+      count++;
+      if (!hits)
+        break;
+      hits[i] = true;
+    }
+  return count;
+}
+
+/**
+Decide whether a single line matches without the DFA, using the mark
+engine, the bitap matcher or the machine. The mark engine counts in ints,
+so a line too long for it goes to the others.
+
+@param rx The compiled regular expression.
+@param w A worker borrowed from rx's pool.
+@param len Length of the line.
+@param str The line to match against.
+@return True if the line contains a match.
+*/
+static bool matchLine(const Regex *rx, Worker *w, long len, const char *str)
+{
+  if (w->ctx && len <= INT_MAX)
+    return matchMarks(rx, w, len, str, NULL) > 0;
+  if (rx->bitap)
+    return runBitap(rx->bitap, len, str);
+  return runMachine(w->m, len, str);
+}
+
+/**
+Find the next line in a buffer that contains a match. If there's a string
+every match must contain, a fast substring search skips straight to the
+next line that contains it, and only that line is handed to the DFA.
+Otherwise, the DFA runs across the whole buffer. Either way, line
+boundaries only need to be found around the lines it reports.
+
+@param rx The compiled regular expression.
+@param w A worker borrowed from rx's pool.
+@param buf The buffer of lines to search.
+@param len Length of the buffer.
+@param start Location of the line to start from, set to the start of the
+             matching line.
+@param end Set to the end of the matching line.
+@return True if a matching line was found.
+*/
+static bool searchLines(const Regex *rx, Worker *w, const char *buf,
+  long len, long *start, long *end)
+{
+  long pos = *start;
+  while (pos < len) {
+    // Narrow the search down to the next candidate line, if possible.
+    long limit = len;
+    if (rx->must) {
+      const char *hit = memmem(buf + pos, len - pos, rx->must, rx->mustLen);
+      if (!hit)
+        break;
+      while (hit > buf + pos && hit[-1] != '\n')
+        hit--;
+      pos = hit - buf;
+      const char *nl = memchr(hit, '\n', len - pos);
+      limit = nl ? nl + 1 - buf : len;
+    }
+
+    // Without a DFA, every line is left to the other matchers.
+    long where = pos;
+    int result;
+    if (rx->ac)
+      result = acSearch(rx->ac, buf, limit, &where) ? DFA_MATCH : DFA_NO_MATCH;
+    else if (w->dfa)
+      result = dfaSearch(w->dfa, buf, limit, &where);
+    else
+      result = DFA_GAVE_UP;
+    if (result == DFA_NO_MATCH) {
+      pos = limit;
+      continue;
+    }
+
+    // Find the line around where the DFA stopped.
+    long first = where;
+    while (first > pos && buf[first - 1] != '\n')
+      first--;
+    const char *nl = memchr(buf + where, '\n', len - where);
+    long last = nl ? nl - buf : len;
+
+    // If the DFA gave up on this line, let the other matchers decide it.
+    if (result == DFA_MATCH ||
+        matchLine(rx, w, last - first, buf + first)) {
+      *start = first;
+      *end = last;
+      return true;
+    }
+
+    pos = last + 1;
+  }
+
+  return false;
+}
+
+bool rx_match(const Regex *rx, const char *str, long len)
+{
+  // An empty buffer has no lines for searchLines() to visit, but an empty
+  // line can still match a pattern like ^$ or a*, so decide it directly.
+  if (len == 0) {
+    Worker *w = takeWorker(rx);
+    bool found = matchLine(rx, w, 0, str);
+    giveWorker(rx, w);
+    return found;
+  }
+
+  long start = 0, end;
+  return rx_search(rx, str, len, &start, &end);
+}
+
+bool rx_search(const Regex *rx, const char *buf, long len, long *start,
+  long *end)
+{
+  Worker *w = takeWorker(rx);
+  bool found = searchLines(rx, w, buf, len, start, end);
+  giveWorker(rx, w);
+  return found;
+}
+
+int rx_which(const Regex *rx, const char *str, long len, bool *hits)
+{
+  memset(hits, 0, rx->npats * sizeof(bool));
+  Worker *w = takeWorker(rx);
+  int count = w->ctx && len <= INT_MAX ?
+    matchMarks(rx, w, len, str, hits) : runMachineSet(w->m, len, str, hits);
+  giveWorker(rx, w);
+  return count;
+}
+
+/**
+Find the leftmost-longest match in a line that starts at or after a given
+location, using the DFAs if they can, or the machine if not.
+
+@param rx The compiled regular expression.
+@param w A worker borrowed from rx's pool, with w->starts filled in if
+         useStarts is true.
+@param str The line to match against.
+@param len Length of the line.
+@param from Location to look for a match from.
+@param useStarts True if w->starts tells where matches start.
+@param span Set to the match, if there is one.
+@return True if there's a match at or after from.
+*/
+static bool nextSpan(const Regex *rx, Worker *w, const char *str, long len,
+  long from, bool useStarts, RxSpan *span)
+{
+  long start, end;
+  if (useStarts) {
+    while (from <= len && !w->starts[from])
+      from++;
+    if (from > len)
+      return false;
+
+    // The anchored DFA finds the end, unless it gives up, and then the
+    // machine looks for the same match, since one starts right there.
+    start = from;
+    if (dfaLongest(w->adfa, len, str, start, &end) != DFA_MATCH &&
+        !runMachineSpan(w->m, len, str, start, &start, &end))
+      return false;
+  } else if (!runMachineSpan(w->m, len, str, from, &start, &end)) {
+    return false;
+  }
+
+  span->start = start;
+  span->end = end;
+  return true;
+}
+
+/**
+Find every location a match starts at in a line, with one backward pass
+of the reverse DFA, unless there's no DFA or it gives up, which leaves
+the whole line to the machine.
+
+@param rx The compiled regular expression.
+@param w A worker borrowed from rx's pool.
+@param str The line to match against.
+@param len Length of the line.
+@param useStarts Set to true if w->starts was filled in.
+@return False if the DFA found that no match starts anywhere in the line.
+*/
+static bool findStarts(const Regex *rx, Worker *w, const char *str,
+  long len, bool *useStarts)
+{
+  *useStarts = false;
+  if (rx->flags & RX_NO_DFA)
+    return true;
+
+  if (!w->rdfa) {
+    w->rdfa = makeDFA(rx->rprog, DFA_BUDGET);
+    w->adfa = makeAnchoredDFA(rx->prog, DFA_BUDGET);
+  }
+  // The space is kept from one line to the next, and doubled when a line
+  // doesn't fit, so a file of growing lines isn't copied over and over.
+  if (len + 1 > w->cap) {
+    w->cap = len + 1 > 2 * w->cap ? len + 1 : 2 * w->cap;
+    w->starts = (bool *)realloc(w->starts, w->cap * sizeof(bool));
+  }
+  int result = dfaMatchStarts(w->rdfa, len, str, w->starts);
+  *useStarts = result == DFA_MATCH;
+  return result != DFA_NO_MATCH;
+}
+
+int rx_spans(const Regex *rx, const char *str, long len, RxSpan *spans,
+  int max)
+{
+  Worker *w = takeWorker(rx);
+  bool useStarts;
+  if (!findStarts(rx, w, str, len, &useStarts)) {
+    giveWorker(rx, w);
+    return 0;
+  }
+
+  // Each match after the first starts where the one before it ended.
+  // Empty ones are skipped, and the next one is looked for a location
+  // later, so matching always gets somewhere.
+  int count = 0;
+  RxSpan span;
+  for (long from = 0; from <= len &&
+       nextSpan(rx, w, str, len, from, useStarts, &span); ) {
+    if (span.end > span.start) {
+      if (count < max)
+        spans[count] = span;
+      count++;
+      from = span.end;
+    } else {
+      from = span.start + 1;
+    }
+  }
+
+  giveWorker(rx, w);
+  return count;
+}
+
+bool rx_captures(const Regex *rx, const char *str, long len,
+  RxSpan *groups, int ngroups)
+{
+  for (int k = 0; k < ngroups; k++)
+    groups[k].start = groups[k].end = -1;
+
+  // Find the whole match the same way rx_spans() does.
+  Worker *w = takeWorker(rx);
+  bool useStarts;
+  RxSpan span;
+  bool found = findStarts(rx, w, str, len, &useStarts) &&
+    nextSpan(rx, w, str, len, 0, useStarts, &span);
+
+  // Then work out how the groups fit in it, if they're wanted.
+  if (found && ngroups > 0) {
+    groups[0] = span;
+    if (rx->cprog && ngroups > 1) {
+      if (!w->capturer) {
+        w->capturer = makeCapturer(rx->cprog);
+        w->slots = (long *)malloc(rx->cprog->nslots * sizeof(long));
+      }
+      runCapturer(w->capturer, len, str, span.start, span.end, w->slots);
+      for (int k = 1; k < ngroups && k <= rx->ngroups; k++) {
+        groups[k].start = w->slots[2 * k];
+        groups[k].end = w->slots[2 * k + 1];
+      }
+    }
+  }
+
+  giveWorker(rx, w);
+  return found;
+}
+
+int rx_groups(const Regex *rx)
+{
+  return rx->ngroups;
+}
+
+void rx_free(Regex *rx)
+{
+  while (rx->pool->idle) {
+    Worker *w = rx->pool->idle;
+    rx->pool->idle = w->next;
+    if (w->dfa)
+      freeDFA(w->dfa);
+    if (w->rdfa) {
+      freeDFA(w->rdfa);
+      freeDFA(w->adfa);
+    }
+    free(w->starts);
+    if (w->capturer) {
+      freeCapturer(w->capturer);
+      free(w->slots);
+    }
+    if (w->ctx)
+      freeMatchContext(w->ctx);
+    freeMachine(w->m);
+    free(w);
+  }
+  pthread_mutex_destroy(&rx->pool->lock);
+  free(rx->pool);
+
+  if (rx->ac)
+    freeAhoCorasick(rx->ac);
+  if (rx->bitap)
+    freeBitap(rx->bitap);
+  freeLiterals(&rx->lit);
+  freeProgram(rx->prog);
+  freeProgram(rx->rprog);
+  if (rx->cprog)
+    freeProgram(rx->cprog);
+  free(rx->pats);
+  freeArena(rx->arena);
+  free(rx);
+}
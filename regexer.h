@@ -0,0 +1,182 @@
+/**
+@file regexer.h
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The regexer.h file contains the public interface of libregexer, the
+library the mygrep program is built on. A pattern is compiled once into a
+Regex handle, which can then be used to match any number of strings.
+<p>
+A handle is never changed by matching with it, so any number of threads
+can share one without locking of their own. The lazily built DFA and the
+machine it falls back on are changed as they're used, so each handle
+keeps a pool of them, and a call borrows one from the pool for as long as
+it runs. A thread only ever builds a new one when every one in the pool is
+already in use by another thread.
+<p>
+Like mygrep, the library matches one line at a time, so a match never
+spans a newline.
+*/
+#ifndef _REGEXER_H_
+#define _REGEXER_H_
+
+#include <stdbool.h>
+
+/** Flag for rx_compile() to skip the literal prefilter and Aho-Corasick. */
+#define RX_NO_LITERALS 0x1
+
+/** Flag for rx_compile() to match each line without a DFA. */
+#define RX_NO_DFA 0x2
+
+/** Flag for rx_compile() to use the machine instead of a Shift-And
+    matcher, for lines the DFA doesn't decide. */
+#define RX_NO_BITAP 0x4
+
+/** Flag for rx_compile() to decide which lines match with the pattern
+    objects' mark engine, instead of the DFA, Shift-And matcher and
+    machine. Finding where matches are is left to the usual engines, and
+    so are lines of INT_MAX characters or more. */
+#define RX_MARKS 0x8
+
+/** A short name to use for a compiled regular expression handle. */
+typedef struct RegexTag Regex;
+
+/** Where one match is in a line. */
+typedef struct {
+  long start;               /* Location of the first character matched */
+  long end;                 /* Location just past the last one */
+} RxSpan;
+
+/**
+Compile a regular expression into a handle for matching with it.
+
+@param pattern The regular expression to compile.
+@param flags Any of the RX_ flags, ORed together, to turn off some of the
+             engines. This is mostly useful for comparing them; 0 uses
+             whichever is fastest for each line.
+@return A dynamically allocated handle, or NULL if pattern isn't a valid
+        regular expression.
+*/
+Regex *rx_compile(const char *pattern, int flags);
+
+/**
+Compile several regular expressions into one handle, which matches
+wherever any of them does. rx_which() reports which ones matched.
+
+@param count Number of entries in patterns.
+@param patterns The regular expressions to compile. NULL or empty entries
+                are skipped, and never match.
+@param flags Any of the RX_ flags, ORed together.
+@return A dynamically allocated handle, or NULL if one of the patterns
+        isn't a valid regular expression.
+*/
+Regex *rx_compile_set(int count, const char *const *patterns, int flags);
+
+/**
+Report whether a single line contains a match.
+
+@param rx The compiled regular expression.
+@param str The line to match against, without its newline.
+@param len Length of the line.
+@return True if the line contains a match.
+*/
+bool rx_match(const Regex *rx, const char *str, long len);
+
+/**
+Find the next line in a buffer of lines that contains a match. Lines are
+separated by newlines, and the last one doesn't need to end with one, so
+an empty buffer has no lines at all. Use rx_match() for an empty line.
+
+@param rx The compiled regular expression.
+@param buf The buffer of lines to search.
+@param len Length of the buffer.
+@param start Location to start searching from, which must be the start of
+             a line. If a line is found, it's set to the start of the line.
+@param end If a line is found, set to the end of the line (the location
+           of its newline, or len for an unterminated last line).
+@return True if a matching line was found.
+*/
+bool rx_search(const Regex *rx, const char *buf, long len, long *start,
+  long *end);
+
+/**
+Work out which of the patterns in a set match a single line.
+
+@param rx A handle made by rx_compile_set(), or rx_compile() for a set of
+          just one.
+@param str The line to match against, without its newline.
+@param len Length of the line.
+@param hits An array with an entry for each pattern the set was compiled
+            from, each set to true if that pattern matches the line.
+@return The number of patterns that match the line.
+*/
+int rx_which(const Regex *rx, const char *str, long len, bool *hits);
+
+/**
+Find where the matches in a single line are, the way grep -o does. The
+first is the leftmost-longest match in the line: the one that starts
+first, and of those, the one that ends last. Each one after that is the
+leftmost-longest match that starts at or after the end of the one before
+it. Empty matches are skipped.
+<p>
+Where matches start is found with one backward pass over the line, and
+where each one ends with a forward pass from its start, so this costs
+little more than matching the line twice.
+
+@param rx The compiled regular expression.
+@param str The line to match against, without its newline.
+@param len Length of the line.
+@param spans An array of max entries, filled in with the matches in the
+             order they appear in the line.
+@param max Number of entries in spans.
+@return The number of matches in the line. If it's more than max, only
+        the first max are filled in.
+*/
+int rx_spans(const Regex *rx, const char *str, long len, RxSpan *spans,
+  int max);
+
+/**
+Find the leftmost-longest match in a single line, the same one rx_spans()
+finds first unless it's empty, and where each parenthesized group in the
+pattern matched within it. Groups are numbered from 1 in the order of
+their opening parentheses. Where there's more than one way to split the
+match between the groups, the first alternative of each | and the longest
+run of each repetition win, and a group inside a repetition reports the
+last time it matched.
+<p>
+Finding the match costs the same as rx_spans(). The groups are only
+worked out after that, within the match, in a single pass if the next
+character always decides how the pattern goes on, and with a thread for
+each way it could otherwise.
+
+@param rx The compiled regular expression. For a set, groups are numbered
+          within each pattern, and only the matching one's are reported.
+@param str The line to match against, without its newline.
+@param len Length of the line.
+@param groups An array of ngroups entries. Entry 0 is set to the whole
+              match, and entry k to group k. Groups that didn't take part
+              in the match, like one repeated zero times, or that aren't
+              in the pattern at all, get -1 for their start and end.
+@param ngroups Number of entries in groups.
+@return True if the line contains a match.
+*/
+bool rx_captures(const Regex *rx, const char *str, long len,
+  RxSpan *groups, int ngroups);
+
+/**
+Return the number of groups in a handle's pattern, not counting the whole
+match, so rx_captures() can be given room for all of them.
+
+@param rx The compiled regular expression.
+@return The most groups any of its patterns has.
+*/
+int rx_groups(const Regex *rx);
+
+/**
+Free a handle, and everything in its pool. No other thread can be using
+it.
+
+@param rx The handle to free.
+*/
+void rx_free(Regex *rx);
+
+#endif
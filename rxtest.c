@@ -0,0 +1,517 @@
+/**
+@file rxtest.c
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The rxtest program checks libregexer through its interface. Each case
+gives a pattern, a line and whether the line should match, and is checked
+with every engine, one RX_ flag combination at a time, so an engine that
+disagrees with the rest is caught even when mygrep would never pick it.
+Random lines are then matched against a few patterns with every engine,
+and they all have to agree.
+<p>
+It prints a line for each check that fails, and exits unsuccessfully if
+there were any.
+*/
+
+/* Headers */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "regexer.h"
+
+/* Constant Definitions */
+#define RANDOM_LINES 2000   /* Random lines matched against each pattern */
+#define RANDOM_LENGTH 300   /* Longest random line */
+#define LONG_LENGTH (1 << 20) /* Length of the long lines */
+#define MAX_GROUPS 5        /* Entries to ask rx_captures() for */
+
+/**
+A named engine, selected by turning the others off with RX_ flags.
+*/
+typedef struct {
+  const char *name;         /* Name printed with failures */
+  int flags;                /* Flags for rx_compile() */
+} Engine;
+
+/**
+A pattern, a line, and whether the line should match.
+*/
+typedef struct {
+  const char *pattern;      /* Pattern to compile */
+  const char *line;         /* Line to match against */
+  bool match;               /* True if the line should match */
+} MatchCase;
+
+/** Engines to check every case with. */
+static const Engine engines[] = {
+  { "auto", 0 },
+  { "dfa", RX_NO_LITERALS },
+  { "bitap", RX_NO_LITERALS | RX_NO_DFA },
+  { "machine", RX_NO_LITERALS | RX_NO_DFA | RX_NO_BITAP },
+  { "marks", RX_NO_LITERALS | RX_MARKS },
+};
+
+/** Number of entries in engines. */
+#define ENGINES (int)(sizeof(engines) / sizeof(engines[0]))
+
+/** Lines to match, and what every engine should say about them. */
+static const MatchCase matchCases[] = {
+  { "abc", "xxabcxx", true },
+  { "abc", "xxabxcx", false },
+  { "a.c", "abc", true },
+  { "^abc$", "abc", true },
+  { "^abc$", "abcd", false },
+  { "ab$", "abab", true },
+  { "x|y|z", "--z--", true },
+  { "(ab|cd)e", "abcde", true },
+  { "(ab|cd)e", "abce", false },
+  { "[a-c][^0-9x]", "a1 bx cy", true },
+  { "[a-c][^0-9x]", "a1 bx c7", false },
+  { "a(bc)*d", "ad", true },
+  { "a(bc)*d", "abcbcbcd", true },
+  { "a(bc)*d", "abcbd", false },
+  { "[0-9]+[.][0-9]+", "pi is 3.14", true },
+  { "[0-9]+[.][0-9]+", "3. and .14", false },
+  { "ab?c", "ac", true },
+  { "ab?c", "abbc", false },
+  { "^(ab)*$", "ababab", true },
+  { "^(ab)*$", "ababa", false },
+  { "^[a-z]{2,4}$", "abcd", true },
+  { "^[a-z]{2,4}$", "abcde", false },
+  { "^(ab){2,}c$", "ababababc", true },
+  { "^(ab){2,}c$", "abc", false },
+  { "x{3}y{0,2}z", "xxxyyz", true },
+  { "x{3}y{0,2}z", "xxxyyyz", false },
+  { "q.*x.*z", "quick fox, lazy", true },
+  { "q.*x.*z", "lazy fox, quick", false },
+  { "^$", "", true },
+  { "^$", "a", false },
+  { "a*", "", true },
+  { "x?", "", true },
+  { "(ab)*", "", true },
+  { "a", "", false },
+  { "^a*$", "", true },
+};
+
+/**
+Patterns that must not compile, including counts that would expand into
+too big a program.
+*/
+static const char *invalidPatterns[] = {
+  "*", "abc[123", "a{5,2}", "a{1001}", "(a{1000}){1000}", "(a{100}){1001,}",
+};
+
+/** A set of patterns, for checking which ones match a line. */
+static const char *setPatterns[] = { "ab", "cd", "x+y", "^b", "" };
+
+/** Number of entries in setPatterns. */
+#define SET_PATTERNS (int)(sizeof(setPatterns) / sizeof(setPatterns[0]))
+
+/**
+A line, and which patterns in setPatterns should match it.
+*/
+typedef struct {
+  const char *line;         /* Line to match against */
+  bool hits[SET_PATTERNS];  /* True for each pattern that should match */
+} SetCase;
+
+/** Lines to match against setPatterns. */
+static const SetCase setCases[] = {
+  { "abcd", { true, true, false, false, false } },
+  { "xxyab", { true, false, true, false, false } },
+  { "bcdxy", { false, true, true, true, false } },
+  { "bcdabxyzz", { true, true, true, true, false } },
+  { "abcdbxy", { true, true, true, false, false } },
+  { "zzz", { false, false, false, false, false } },
+};
+
+/**
+A pattern, or a set of two, a line, and where the match and each group
+in it should be found.
+*/
+typedef struct {
+  const char *pattern;      /* Pattern to compile */
+  const char *other;        /* Second pattern to compile into a set with
+                               it, or NULL */
+  const char *line;         /* Line to match against */
+  int groups;               /* What rx_groups() should report */
+  long spans[MAX_GROUPS][2]; /* Start and end of the match, then of each
+                               group, -1 for ones that don't take part;
+                               entries past groups are always -1 */
+} CaptureCase;
+
+/** Lines to find groups in, and where each group should be. */
+static const CaptureCase captureCases[] = {
+  // The first alternative of each | wins, as long as the whole match is
+  // still the leftmost-longest.
+  { "(a|ab)(c|bcd)(d*)", NULL, "abcd", 3,
+    { { 0, 4 }, { 0, 1 }, { 1, 4 }, { 4, 4 } } },
+  { "x(a|ab)(b*)y", NULL, "xaby", 2, { { 0, 4 }, { 1, 2 }, { 2, 3 } } },
+  // A group inside a repetition reports the last time it matched.
+  { "(a|b)*c", NULL, "abbac", 1, { { 0, 5 }, { 3, 4 } } },
+  { "((a)|(b))+", NULL, "ab", 3, { { 0, 2 }, { 1, 2 }, { 0, 1 }, { 1, 2 } } },
+  { "((ab)*|c)d", NULL, "ababd", 2, { { 0, 5 }, { 0, 4 }, { 2, 4 } } },
+  // Groups that don't take part get -1.
+  { "(a)|(b)", NULL, "b", 2, { { 0, 1 }, { -1, -1 }, { 0, 1 } } },
+  { "x(y)?z", NULL, "xz", 1, { { 0, 2 }, { -1, -1 } } },
+  { "(ab)*x", NULL, "xx", 1, { { 0, 1 }, { -1, -1 } } },
+  { "a(b)c", NULL, "xyz", 1, { { -1, -1 }, { -1, -1 } } },
+  // In a set, groups are numbered within each pattern, and only the
+  // matching one's are reported.
+  { "(a)(b)", "c(d)", "xcd", 2, { { 1, 3 }, { 2, 3 }, { -1, -1 } } },
+  { "(a)(b)", "c(d)", "cdab", 2, { { 0, 2 }, { 1, 2 }, { -1, -1 } } },
+  { "(a)(b)", "c(d)", "zab", 2, { { 1, 3 }, { 1, 2 }, { 2, 3 } } },
+};
+
+/** State of the pseudo-random number generator, so runs are repeatable. */
+static uint64_t seed = 88172645463325252ULL;
+
+/**
+Return the next pseudo-random number, from a xorshift generator.
+
+@param n Number of values to choose from.
+@return A number from 0 to n - 1.
+*/
+static int next(int n)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed % n;
+}
+
+/** Number of checks that failed so far. */
+static int failures = 0;
+
+/**
+Report a failed check, and count it.
+
+@param what Which kind of check failed.
+@param pattern The pattern being checked.
+@param line The line it was matched against.
+@param engine Name of the engine that got it wrong.
+*/
+static void fail(const char *what, const char *pattern, const char *line,
+  const char *engine)
+{
+  fprintf(stderr, "%s failed: '%s' on '%s' with %s\n", what, pattern, line,
+    engine);
+  failures++;
+}
+
+/**
+Compile a pattern, counting it as a failure if it doesn't compile.
+
+@param pattern The pattern to compile.
+@param flags Flags for rx_compile().
+@return The compiled handle, or NULL if it didn't compile.
+*/
+static Regex *compile(const char *pattern, int flags)
+{
+  Regex *rx = rx_compile(pattern, flags);
+  if (!rx) {
+    fprintf(stderr, "Can't compile '%s'\n", pattern);
+    failures++;
+  }
+  return rx;
+}
+
+
+/********************************************************************
+*
+*                             CHECKS
+*
+********************************************************************/
+/**
+Check every match case with every engine, both with rx_match() and with
+rx_search() from the start of the line in a buffer, between two others.
+The one after it must not match.
+*/
+static void checkMatches()
+{
+  int count = sizeof(matchCases) / sizeof(matchCases[0]);
+  for (int i = 0; i < count; i++) {
+    const MatchCase *c = &matchCases[i];
+    char buf[256];
+    int len = snprintf(buf, sizeof(buf), "--\n%s\n--", c->line);
+    for (int e = 0; e < ENGINES; e++) {
+      Regex *rx = compile(c->pattern, engines[e].flags);
+      if (!rx)
+        continue;
+      if (rx_match(rx, c->line, strlen(c->line)) != c->match)
+        fail("rx_match", c->pattern, c->line, engines[e].name);
+
+      long start = 3, end;
+      bool found = rx_search(rx, buf, len, &start, &end);
+      if (found != c->match ||
+          (found && (start != 3 || end != len - 3)))
+        fail("rx_search", c->pattern, c->line, engines[e].name);
+      rx_free(rx);
+    }
+  }
+}
+
+/**
+Check where the match and its groups are for every capture case, with
+every engine.
+*/
+static void checkCaptures()
+{
+  int count = sizeof(captureCases) / sizeof(captureCases[0]);
+  for (int i = 0; i < count; i++) {
+    const CaptureCase *c = &captureCases[i];
+    const char *patterns[] = { c->pattern, c->other };
+    for (int e = 0; e < ENGINES; e++) {
+      Regex *rx = rx_compile_set(c->other ? 2 : 1, patterns,
+        engines[e].flags);
+      if (!rx) {
+        fprintf(stderr, "Can't compile '%s'\n", c->pattern);
+        failures++;
+        continue;
+      }
+      if (rx_groups(rx) != c->groups)
+        fail("rx_groups", c->pattern, c->line, engines[e].name);
+
+      RxSpan spans[MAX_GROUPS];
+      bool expected = c->spans[0][0] >= 0;
+      bool ok = rx_captures(rx, c->line, strlen(c->line), spans,
+        MAX_GROUPS) == expected;
+      for (int k = 0; k < MAX_GROUPS; k++) {
+        long start = k <= c->groups ? c->spans[k][0] : -1;
+        long end = k <= c->groups ? c->spans[k][1] : -1;
+        ok = ok && spans[k].start == start && spans[k].end == end;
+      }
+      if (!ok)
+        fail("rx_captures", c->pattern, c->line, engines[e].name);
+      rx_free(rx);
+    }
+  }
+}
+
+/**
+Check that every invalid pattern fails to compile, with every engine.
+*/
+static void checkInvalid()
+{
+  int count = sizeof(invalidPatterns) / sizeof(invalidPatterns[0]);
+  for (int i = 0; i < count; i++)
+    for (int e = 0; e < ENGINES; e++) {
+      Regex *rx = rx_compile(invalidPatterns[i], engines[e].flags);
+      if (rx) {
+        fail("rx_compile", invalidPatterns[i], "", engines[e].name);
+        rx_free(rx);
+      }
+    }
+}
+
+/**
+Check which patterns of a set match each set case with every engine,
+including lines where every pattern that can match does, so matching
+stops early.
+*/
+static void checkSets()
+{
+  int count = sizeof(setCases) / sizeof(setCases[0]);
+  for (int e = 0; e < ENGINES; e++) {
+    Regex *rx = rx_compile_set(SET_PATTERNS, setPatterns, engines[e].flags);
+    if (!rx) {
+      fprintf(stderr, "Can't compile the set\n");
+      failures++;
+      continue;
+    }
+    for (int i = 0; i < count; i++) {
+      const SetCase *c = &setCases[i];
+      bool hits[SET_PATTERNS];
+      int expected = 0;
+      for (int k = 0; k < SET_PATTERNS; k++)
+        expected += c->hits[k];
+      bool ok = rx_which(rx, c->line, strlen(c->line), hits) == expected;
+      for (int k = 0; k < SET_PATTERNS; k++)
+        ok = ok && hits[k] == c->hits[k];
+      if (!ok)
+        fail("rx_which", "set", c->line, engines[e].name);
+    }
+    rx_free(rx);
+  }
+}
+
+/**
+Match random lines against patterns with every engine, and check they
+all agree with the first. Lines are made from a few letters, so the
+patterns match some of them, and are long enough that the mark engine
+has to grow its scratch space.
+*/
+static void checkAgreement()
+{
+  static const char *patterns[] = {
+    "ab*c", "(ab|ba)+c", "a.?b.?c", "^[ab]*c", "[bc]{2,3}a$", "(a|b)*bab",
+  };
+  int npatterns = sizeof(patterns) / sizeof(patterns[0]);
+  static char line[RANDOM_LENGTH + 1];
+
+  for (int p = 0; p < npatterns; p++) {
+    Regex *rx[ENGINES];
+    bool ok = true;
+    for (int e = 0; e < ENGINES; e++)
+      if (!(rx[e] = compile(patterns[p], engines[e].flags)))
+        ok = false;
+
+    for (int i = 0; ok && i < RANDOM_LINES; i++) {
+      int len = next(RANDOM_LENGTH + 1);
+      for (int k = 0; k < len; k++)
+        line[k] = "abcd"[next(4)];
+      line[len] = '\0';
+
+      bool expected = rx_match(rx[0], line, len);
+      for (int e = 1; e < ENGINES; e++)
+        if (rx_match(rx[e], line, len) != expected)
+          fail("Agreement", patterns[p], line, engines[e].name);
+    }
+
+    for (int e = 0; e < ENGINES; e++)
+      if (rx[e])
+        rx_free(rx[e]);
+  }
+}
+
+/**
+Match each of a list of patterns against one long line with every
+engine.
+
+@param cases The patterns, what to call the line in failures, and
+             whether it should match.
+@param count Number of entries in cases.
+@param line The line to match against.
+@param len Length of the line.
+*/
+static void checkLongLine(const MatchCase *cases, int count,
+  const char *line, int len)
+{
+  for (int i = 0; i < count; i++)
+    for (int e = 0; e < ENGINES; e++) {
+      Regex *rx = compile(cases[i].pattern, engines[e].flags);
+      if (!rx)
+        continue;
+      if (rx_match(rx, line, len) != cases[i].match)
+        fail("Long line", cases[i].pattern, cases[i].line, engines[e].name);
+      rx_free(rx);
+    }
+}
+
+/**
+Match repetitions against lines a megabyte long with every engine. The
+mark engine only matches from each location once, so these finish
+quickly, where going over the whole line again for each repetition would
+take minutes.
+*/
+static void checkLongLines()
+{
+  char *line = (char *)malloc(LONG_LENGTH + 1);
+
+  // A line of ab pairs, ending in an x.
+  static const MatchCase pairs[] = {
+    { "^(ab)*x$", "abab...abx", true },
+    { "^(ab)+x$", "abab...abx", true },
+    { "^(ab|ba)*x$", "abab...abx", true },
+    { "^(ab)*$", "abab...abx", false },
+    { "^(a|b)*bb", "abab...abx", false },
+  };
+  for (int k = 0; k < LONG_LENGTH; k++)
+    line[k] = "ab"[k % 2];
+  line[LONG_LENGTH] = 'x';
+  checkLongLine(pairs, sizeof(pairs) / sizeof(pairs[0]), line,
+    LONG_LENGTH + 1);
+
+  // A line of digits, with an x in the middle.
+  static const MatchCase digits[] = {
+    { "^[0-9]+$", "0123...x...789", false },
+    { "^[0-9]+x[0-9]+$", "0123...x...789", true },
+    { "([0-9][0-9])+y", "0123...x...789", false },
+  };
+  for (int k = 0; k < LONG_LENGTH; k++)
+    line[k] = '0' + k % 10;
+  line[LONG_LENGTH / 2] = 'x';
+  checkLongLine(digits, sizeof(digits) / sizeof(digits[0]), line,
+    LONG_LENGTH);
+
+  free(line);
+}
+
+/**
+Match classes with a NUL in them, which the literal strings can't hold,
+against lines with NULs in them, with every engine. Each line is checked
+with rx_match(), and the buffer of all of them with rx_search(), which
+must only find the ones that match.
+*/
+static void checkNulLines()
+{
+  // Lines, separated by newlines, named in failures by how they look.
+  static const char buf[] = "xy\nx\001y\nx\0y\nxzy";
+  static const char *names[] = { "xy", "x\\001y", "x\\0y", "xzy" };
+  static const long starts[] = { 0, 3, 7, 11, sizeof(buf) };
+
+  // Patterns, and which of the lines each should match.
+  static const struct {
+    const char *pattern;
+    bool match[4];
+  } cases[] = {
+    { "x[^\002-\377]y", { false, true, true, false } },
+    { "x[^\001-\377]y", { false, false, true, false } },
+    { "^x[^\001-\377]", { false, false, true, false } },
+  };
+
+  for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++)
+    for (int e = 0; e < ENGINES; e++) {
+      Regex *rx = compile(cases[i].pattern, engines[e].flags);
+      if (!rx)
+        continue;
+      for (int k = 0; k < 4; k++) {
+        if (rx_match(rx, buf + starts[k], starts[k + 1] - starts[k] - 1) !=
+            cases[i].match[k])
+          fail("rx_match", cases[i].pattern, names[k], engines[e].name);
+
+        // From the start of this line, rx_search() must find the next one
+        // that matches.
+        int next = k;
+        while (next < 4 && !cases[i].match[next])
+          next++;
+        long start = starts[k], end;
+        bool found = rx_search(rx, buf, sizeof(buf) - 1, &start, &end);
+        if (found != (next < 4) ||
+            (found && (start != starts[next] ||
+                       end != starts[next + 1] - 1)))
+          fail("rx_search", cases[i].pattern, names[k], engines[e].name);
+      }
+      rx_free(rx);
+    }
+}
+
+/********************************************************************
+*
+*                           MAIN METHOD
+*
+********************************************************************/
+/**
+The main method for the rxtest program. It runs every check, and reports
+how many failed.
+
+@return EXIT_SUCCESS if every check passed, EXIT_FAILURE if not.
+*/
+int main()
+{
+  checkMatches();
+  checkInvalid();
+  checkSets();
+  checkCaptures();
+  checkAgreement();
+  checkLongLines();
+  checkNulLines();
+
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return(EXIT_FAILURE);
+  }
+  return(EXIT_SUCCESS);
+}
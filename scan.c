@@ -0,0 +1,256 @@
+/**
+@file scan.c
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The scan.c component implements the character scanning kernels, in a
+portable version and, on x86, versions using SSSE3 and AVX2. Comparing
+against a symbol is a byte-wise compare and a movemask. Looking characters
+up in a set uses each character's low nibble to pick a byte from the set's
+nibble table with a shuffle, and its high nibble to pick which bit of that
+byte to test.
+*/
+
+/* Headers */
+#include "scan.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+
+/********************************************************************
+*
+*                          BYTE SET FUNCTIONS
+*
+********************************************************************/
+void clearByteSet(ByteSet *set)
+{
+  memset(set, 0, sizeof(ByteSet));
+}
+
+void addByte(ByteSet *set, unsigned char c)
+{
+  set->bits[c / 8] |= 1 << (c % 8);
+  if (c < 128)
+    set->lo[c & 15] |= 1 << (c >> 4);
+  else
+    set->hi[c & 15] |= 1 << ((c >> 4) - 8);
+}
+
+void invertByteSet(ByteSet *set)
+{
+  ByteSet old = *set;
+  clearByteSet(set);
+  for (int c = 0; c < 256; c++)
+    if (!inByteSet(&old, c))
+      addByte(set, c);
+}
+
+bool inByteSet(const ByteSet *set, unsigned char c)
+{
+  return (set->bits[c / 8] >> (c % 8)) & 1;
+}
+
+
+/********************************************************************
+*
+*                          PORTABLE KERNELS
+*
+********************************************************************/
+/**
+Compare characters against a symbol one at a time.
+*/
+static uint64_t scanSymbolPortable(const char *str, int n, char sym)
+{
+  uint64_t mask = 0;
+  for (int i = 0; i < n; i++)
+    mask |= (uint64_t)(str[i] == sym) << i;
+  return mask;
+}
+
+/**
+Look characters up in a set one at a time.
+*/
+static uint64_t scanByteSetPortable(const ByteSet *set, const char *str, int n)
+{
+  uint64_t mask = 0;
+  for (int i = 0; i < n; i++)
+    mask |= (uint64_t)inByteSet(set, str[i]) << i;
+  return mask;
+}
+
+
+#ifdef SCAN_X86
+/********************************************************************
+*
+*                          SSSE3 KERNELS
+*
+********************************************************************/
+/**
+Compare SCAN_WIDTH characters against a symbol, 16 at a time.
+*/
+__attribute__((target("ssse3")))
+static uint64_t scanSymbolSSSE3(const char *str, char sym)
+{
+  __m128i s = _mm_set1_epi8(sym);
+  uint64_t mask = 0;
+  for (int i = 0; i < SCAN_WIDTH; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(str + i));
+    mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, s)) << i;
+  }
+  return mask;
+}
+
+/**
+Look SCAN_WIDTH characters up in a set, 16 at a time.
+*/
+__attribute__((target("ssse3")))
+static uint64_t scanByteSetSSSE3(const ByteSet *set, const char *str)
+{
+  __m128i lo = _mm_loadu_si128((const __m128i *)set->lo);
+  __m128i hi = _mm_loadu_si128((const __m128i *)set->hi);
+  __m128i bit = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                              1, 2, 4, 8, 16, 32, 64, -128);
+  __m128i nibble = _mm_set1_epi8(0x8f);
+  __m128i top = _mm_set1_epi8(-128);
+  __m128i seven = _mm_set1_epi8(7);
+  uint64_t mask = 0;
+
+  for (int i = 0; i < SCAN_WIDTH; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(str + i));
+    // A shuffle gives zero for an index with its top bit set, so keeping
+    // that bit picks from lo for characters below 128 and hi for the rest.
+    __m128i index = _mm_and_si128(v, nibble);
+    __m128i row = _mm_or_si128(_mm_shuffle_epi8(lo, index),
+      _mm_shuffle_epi8(hi, _mm_xor_si128(index, top)));
+    __m128i col = _mm_shuffle_epi8(bit,
+      _mm_and_si128(_mm_srli_epi16(v, 4), seven));
+    __m128i miss = _mm_cmpeq_epi8(_mm_and_si128(row, col),
+      _mm_setzero_si128());
+    mask |= (uint64_t)(uint16_t)~_mm_movemask_epi8(miss) << i;
+  }
+  return mask;
+}
+
+
+/********************************************************************
+*
+*                          AVX2 KERNELS
+*
+********************************************************************/
+/**
+Compare SCAN_WIDTH characters against a symbol, 32 at a time.
+*/
+__attribute__((target("avx2")))
+static uint64_t scanSymbolAVX2(const char *str, char sym)
+{
+  __m256i s = _mm256_set1_epi8(sym);
+  __m256i v0 = _mm256_loadu_si256((const __m256i *)str);
+  __m256i v1 = _mm256_loadu_si256((const __m256i *)(str + 32));
+  uint32_t m0 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v0, s));
+  uint32_t m1 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v1, s));
+  return (uint64_t)m1 << 32 | m0;
+}
+
+/**
+Look SCAN_WIDTH characters up in a set, 32 at a time. Shuffles only work
+within each 16-byte half of a register, so the tables are copied into
+both halves.
+*/
+__attribute__((target("avx2")))
+static uint64_t scanByteSetAVX2(const ByteSet *set, const char *str)
+{
+  __m256i lo = _mm256_broadcastsi128_si256(
+    _mm_loadu_si128((const __m128i *)set->lo));
+  __m256i hi = _mm256_broadcastsi128_si256(
+    _mm_loadu_si128((const __m128i *)set->hi));
+  __m256i bit = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                 1, 2, 4, 8, 16, 32, 64, -128,
+                                 1, 2, 4, 8, 16, 32, 64, -128,
+                                 1, 2, 4, 8, 16, 32, 64, -128);
+  __m256i nibble = _mm256_set1_epi8(0x8f);
+  __m256i top = _mm256_set1_epi8(-128);
+  __m256i seven = _mm256_set1_epi8(7);
+  uint64_t mask = 0;
+
+  for (int i = 0; i < SCAN_WIDTH; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(str + i));
+    __m256i index = _mm256_and_si256(v, nibble);
+    __m256i row = _mm256_or_si256(_mm256_shuffle_epi8(lo, index),
+      _mm256_shuffle_epi8(hi, _mm256_xor_si256(index, top)));
+    __m256i col = _mm256_shuffle_epi8(bit,
+      _mm256_and_si256(_mm256_srli_epi16(v, 4), seven));
+    __m256i miss = _mm256_cmpeq_epi8(_mm256_and_si256(row, col),
+      _mm256_setzero_si256());
+    mask |= (uint64_t)(uint32_t)~_mm256_movemask_epi8(miss) << i;
+  }
+  return mask;
+}
+#endif
+
+
+/********************************************************************
+*
+*                          KERNEL DISPATCH
+*
+********************************************************************/
+/** Kernel used for a full SCAN_WIDTH characters compared with a symbol. */
+static uint64_t (*symbolKernel)(const char *str, char sym);
+
+/** Kernel used for a full SCAN_WIDTH characters looked up in a set. */
+static uint64_t (*byteSetKernel)(const ByteSet *set, const char *str);
+
+/**
+Portable kernel for a full SCAN_WIDTH characters compared with a symbol.
+*/
+static uint64_t scanSymbolWide(const char *str, char sym)
+{
+  return scanSymbolPortable(str, SCAN_WIDTH, sym);
+}
+
+/**
+Portable kernel for a full SCAN_WIDTH characters looked up in a set.
+*/
+static uint64_t scanByteSetWide(const ByteSet *set, const char *str)
+{
+  return scanByteSetPortable(set, str, SCAN_WIDTH);
+}
+
+/**
+Pick the fastest kernels this processor can run. This runs once, before
+main(), so every thread sees the same choice without any locking.
+*/
+__attribute__((constructor))
+static void chooseKernels()
+{
+  symbolKernel = scanSymbolWide;
+  byteSetKernel = scanByteSetWide;
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    symbolKernel = scanSymbolAVX2;
+    byteSetKernel = scanByteSetAVX2;
+  } else if (__builtin_cpu_supports("ssse3")) {
+    symbolKernel = scanSymbolSSSE3;
+    byteSetKernel = scanByteSetSSSE3;
+  }
+#endif
+}
+
+uint64_t scanSymbol(const char *str, int n, char sym)
+{
+  // Only full runs go to the vector kernels, so they never read past the
+  // end of the string.
+  if (n == SCAN_WIDTH)
+    return symbolKernel(str, sym);
+  return scanSymbolPortable(str, n, sym);
+}
+
+uint64_t scanByteSet(const ByteSet *set, const char *str, int n)
+{
+  if (n == SCAN_WIDTH)
+    return byteSetKernel(set, str);
+  return scanByteSetPortable(set, str, n);
+}
@@ -0,0 +1,87 @@
+/**
+@file scan.h
+@author Stephen Hildebrand (sfhildeb@gmail.com)
+
+The scan.h file contains the interface for the kernels that test a run of
+up to 64 characters against a symbol or a set of characters all at once,
+producing a bitmask with one bit per character. Patterns AND these masks
+with their marks, so they never have to look at characters one by one,
+and searches use them to skip to the next character that matters.
+<p>
+Where the processor supports it, the kernels compare 16 or 32 characters
+per instruction. The fastest version the processor can run is picked once,
+when the program starts.
+*/
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Most characters a single kernel call looks at. */
+#define SCAN_WIDTH 64
+
+/**
+A set of characters, kept both as a plain bitmap and as the pair of
+nibble tables the vector kernels look characters up in. For a character
+c, bit (c >> 4) % 8 of lo[c & 15] (for c < 128) or hi[c & 15] (for
+c >= 128) is set if c is in the set.
+*/
+typedef struct {
+  uint8_t bits[32];   /* Bit c % 8 of bits[c / 8] is set if c is in the set */
+  uint8_t lo[16];     /* Nibble table for characters 0 - 127 */
+  uint8_t hi[16];     /* Nibble table for characters 128 - 255 */
+} ByteSet;
+
+/**
+Make set empty.
+
+@param set The set to clear.
+*/
+void clearByteSet(ByteSet *set);
+
+/**
+Add a character to a set.
+
+@param set The set to add to.
+@param c The character to add.
+*/
+void addByte(ByteSet *set, unsigned char c);
+
+/**
+Replace a set with every character that's not in it.
+
+@param set The set to invert.
+*/
+void invertByteSet(ByteSet *set);
+
+/**
+Report whether a character is in a set.
+
+@param set The set to look in.
+@param c The character to look for.
+@return True if c is in set.
+*/
+bool inByteSet(const ByteSet *set, unsigned char c);
+
+/**
+Compare up to SCAN_WIDTH characters against a symbol.
+
+@param str The characters to compare.
+@param n Number of characters to compare, at most SCAN_WIDTH.
+@param sym The symbol to compare them with.
+@return A mask with bit i set if i < n and str[i] is sym.
+*/
+uint64_t scanSymbol(const char *str, int n, char sym);
+
+/**
+Look up to SCAN_WIDTH characters up in a set.
+
+@param set The set to look them up in.
+@param str The characters to look up.
+@param n Number of characters to look up, at most SCAN_WIDTH.
+@return A mask with bit i set if i < n and str[i] is in set.
+*/
+uint64_t scanByteSet(const ByteSet *set, const char *str, int n);
+
+#endif
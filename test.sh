@@ -77,6 +77,13 @@ runtest() {
     shift
     EX_STATUS="$1"
     shift
+    # Anything left is options to go before the pattern.
+    OPTIONS="$*"
+    # An empty pattern is left out, for tests that give -f instead.
+    PATTERN=()
+    if [ -n "$pattern" ]; then
+	PATTERN=("$pattern")
+    fi
 
     # Remove any files that we want to test for.
     rm -f output.txt stderr.txt
@@ -84,12 +91,12 @@ runtest() {
     # Read either from a file or standard input.
     if [ "$MODE" == "stdin" ]
     then
-	echo "Test $TESTNO: ./mygrep '$pattern' < input_$TESTNO.txt > output.txt 2> stderr.txt"
-	./mygrep "$pattern" < input_$TESTNO.txt > output.txt 2> stderr.txt
+	echo "Test $TESTNO: ./mygrep $OPTIONS ${pattern:+'$pattern'} < input_$TESTNO.txt > output.txt 2> stderr.txt"
+	./mygrep $OPTIONS "${PATTERN[@]}" < input_$TESTNO.txt > output.txt 2> stderr.txt
 	STATUS=$?
     else
-	echo "Test $TESTNO: ./mygrep '$pattern' input_$TESTNO.txt > output.txt 2> stderr.txt"
-	./mygrep "$pattern" input_$TESTNO.txt > output.txt 2> stderr.txt
+	echo "Test $TESTNO: ./mygrep $OPTIONS ${pattern:+'$pattern'} input_$TESTNO.txt > output.txt 2> stderr.txt"
+	./mygrep $OPTIONS "${PATTERN[@]}" input_$TESTNO.txt > output.txt 2> stderr.txt
 	STATUS=$?
     fi
 
@@ -137,6 +144,12 @@ runtest 11 'ab?c' file 0
 runtest 12 'a(bc)*d' file 0
 runtest 13 '^Your (license|application|program) has been (revoked|accepted|tested)!$' file 0
 runtest 14 '[0123456789]+[.][0123456789]+' file 0
+runtest 19 '[a-c][^0-9x]' file 0
+runtest 20 '' file 0 -f patterns_20.txt
+runtest 21 '^[A-Z][a-z]{2,}: [0-9]{3}-[0-9]{4}( x[0-9]{1,5})?$' file 0
+runtest 22 '[0-9]+(ms|s)' file 0 -o -b
+runtest 23 'licen(s|c)e[sd]?|license|licence|colou?r|colo(u)?red|gr(e|a)y|(x*)*y|ab**c' file 0 -o
+runtest 26 '-foo|-b$' file 0 -b --
 
 runtest 15 '*' file 1
 runtest 16 'abc[123' file 1
@@ -153,6 +166,25 @@ if failCheck 18 "$STATUS"; then
     echo "Test 18 passed"
 fi
 
+rm -f output.txt stderr.txt
+echo "Test 24: ./mygrep -j 4x abc input_01.txt > output.txt 2> stderr.txt"
+./mygrep -j 4x abc input_01.txt > output.txt 2> stderr.txt
+STATUS=$?
+
+if failCheck 24 "$STATUS"; then
+    echo "Test 24 passed"
+fi
+
+# Library tests, which check every engine, including ones mygrep never
+# picks on its own.
+echo "Test 25: ./rxtest"
+if make rxtest > /dev/null && ./rxtest; then
+    echo "Test 25 passed"
+else
+    echo "   **** Test failed - library checks failed"
+    FAIL=1
+fi
+
 if [ $FAIL -ne 0 ]; then
   echo "FAILING TESTS!"
   exit 13